@@ -5,11 +5,14 @@
 #ifndef SP_EXAM_PROJECT_SYMBOLTABLE_H
 #define SP_EXAM_PROJECT_SYMBOLTABLE_H
 
-#include <unordered_map>
 #include <string>
+#include <string_view>
 #include <stdexcept>
 #include <utility>
 #include <iterator>
+#include <vector>
+#include <optional>
+#include <cstdint>
 
 namespace StochasticSimulation {
 
@@ -21,89 +24,196 @@ namespace StochasticSimulation {
         explicit SymbolTableException(std::string message): message(std::move(message))
         {}
 
-        [[nodiscard]] const char* what() const override
+        [[nodiscard]] const char* what() const noexcept override
         {
             return message.c_str();
         }
     };
 
+    // Interned id of a key. Ids are handed out densely in insertion order, so a symbol
+    // resolved once stays valid for the table and for every copy made of it afterwards.
+    struct Symbol {
+        size_t id;
+
+        bool operator==(const Symbol& other) const = default;
+    };
+
+    // Entries are stored densely and indexed by symbol id, the keys are found through
+    // a flat open-addressing (linear probing) table of indices into the entries.
     template<typename T>
     class SymbolTable {
-        using map_type = std::unordered_map<std::string, T>;
-    private:
-        map_type map{};
-    public:
-        using iterator = typename map_type::iterator;
-        using const_iterator = typename map_type::const_iterator;
+        // The key is const, renaming an entry through an iterator would leave it in the wrong slot
+        using entry_type = std::pair<const std::string, T>;
+        using entries_type = std::vector<entry_type>;
 
-        SymbolTable<T>() = default;
+        static constexpr uint32_t empty_slot = UINT32_MAX;
 
-        SymbolTable<T>(const SymbolTable<T>& a) {
-            map = a.map;
+        struct Slot {
+            size_t hash{0};
+            uint32_t index{empty_slot};
         };
+    private:
+        entries_type entries{};
+        std::vector<Slot> slots{};
 
-        SymbolTable<T>(SymbolTable<T>&& a) {
-            map = std::move(a.map);
-        };
+        static size_t hash_key(std::string_view key) {
+            return std::hash<std::string_view>{}(key);
+        }
+
+        // Position of the slot holding key, or of the empty slot where it would be inserted
+        [[nodiscard]] size_t find_slot(std::string_view key, size_t hash) const {
+            auto mask = slots.size() - 1;
+            auto position = hash & mask;
+
+            while (slots[position].index != empty_slot) {
+                auto& slot = slots[position];
+                if (slot.hash == hash && entries[slot.index].first == key) {
+                    break;
+                }
+                position = (position + 1) & mask;
+            }
+
+            return position;
+        }
+
+        // Keep the load factor at or below one half
+        void grow() {
+            auto capacity = slots.empty() ? 16 : slots.size() * 2;
+            slots.assign(capacity, Slot{});
+
+            for (uint32_t i = 0; i < entries.size(); ++i) {
+                auto hash = hash_key(entries[i].first);
+                slots[find_slot(entries[i].first, hash)] = Slot{hash, i};
+            }
+        }
+
+        [[nodiscard]] std::optional<size_t> index_of(std::string_view key) const {
+            if (slots.empty()) {
+                return std::nullopt;
+            }
+
+            auto& slot = slots[find_slot(key, hash_key(key))];
+            if (slot.index == empty_slot) {
+                return std::nullopt;
+            }
+            return slot.index;
+        }
+    public:
+        using iterator = typename entries_type::iterator;
+        using const_iterator = typename entries_type::const_iterator;
+
+        SymbolTable() = default;
+        SymbolTable(const SymbolTable& a) = default;
+        SymbolTable(SymbolTable&& a) noexcept = default;
 
         ~SymbolTable() = default;
 
-        SymbolTable<T>& operator=(const SymbolTable& a) {
-            map = a.map;
+        // Entries with a const key cannot be assigned, so they are copied in anew
+        SymbolTable& operator=(const SymbolTable& a) {
+            if (this != &a) {
+                entries.clear();
+                entries.reserve(a.entries.size());
+                for (auto& entry: a.entries) {
+                    entries.emplace_back(entry);
+                }
+                slots = a.slots;
+            }
             return *this;
-        };
+        }
 
-        SymbolTable<T>& operator=(SymbolTable&& a) {
-            map = std::move(a.map);
-            return *this;
-        };
+        SymbolTable& operator=(SymbolTable&& a) noexcept = default;
+
+        Symbol put(std::string_view key, T value) {
+            if ((entries.size() + 1) * 2 > slots.size()) {
+                grow();
+            }
+
+            auto hash = hash_key(key);
+            auto position = find_slot(key, hash);
 
-        void put(const std::string& key, T value) {
-            if (!map.contains(key)) {
-                map.insert_or_assign(key, value);
-            } else {
-                throw SymbolTableException("Key " + key + " already used");
+            if (slots[position].index != empty_slot) {
+                throw SymbolTableException("Key " + std::string(key) + " already used");
             }
+
+            // The slot is only published once the entry exists, a throwing insert leaves the table as it was
+            entries.emplace_back(std::string(key), std::move(value));
+            slots[position] = Slot{hash, static_cast<uint32_t>(entries.size() - 1)};
+
+            return Symbol{entries.size() - 1};
+        }
+
+        T& get(std::string_view key) {
+            return entries[symbol(key).id].second;
+        }
+
+        const T& get(std::string_view key) const {
+            return entries[symbol(key).id].second;
         }
 
-        T& get(const std::string& key) {
-            try {
-                return map.at(key);
-            } catch (std::out_of_range& e) {
-                throw SymbolTableException("Key " + key + " was not found");
+        // O(1) access through a symbol resolved earlier
+        T& get(Symbol symbol) {
+            return entries[symbol.id].second;
+        }
+
+        const T& get(Symbol symbol) const {
+            return entries[symbol.id].second;
+        }
+
+        T& operator[](Symbol symbol) {
+            return entries[symbol.id].second;
+        }
+
+        const T& operator[](Symbol symbol) const {
+            return entries[symbol.id].second;
+        }
+
+        // Resolve a key to its symbol, meant to be done once outside hot loops
+        [[nodiscard]] Symbol symbol(std::string_view key) const {
+            auto index = index_of(key);
+            if (!index.has_value()) {
+                throw SymbolTableException("Key " + std::string(key) + " was not found");
             }
+            return Symbol{index.value()};
         }
 
-        const T& get(const std::string& key) const {
-            try {
-                return map.at(key);
-            } catch (std::out_of_range& e) {
-                throw SymbolTableException("Key " + key + " was not found");
+        [[nodiscard]] std::optional<Symbol> find(std::string_view key) const {
+            auto index = index_of(key);
+            if (!index.has_value()) {
+                return std::nullopt;
             }
+            return Symbol{index.value()};
+        }
+
+        [[nodiscard]] bool contains(std::string_view key) const {
+            return index_of(key).has_value();
+        }
+
+        [[nodiscard]] const std::string& key(Symbol symbol) const {
+            return entries[symbol.id].first;
         }
 
-        bool contains(const std::string& key) {
-            return map.contains(key);
+        [[nodiscard]] size_t size() const {
+            return entries.size();
         }
 
-        std::unordered_map<std::string, T> getMap() {
-            return map;
+        [[nodiscard]] bool empty() const {
+            return entries.empty();
         }
 
         iterator begin() {
-            return map.begin();
+            return entries.begin();
         }
 
         iterator end() {
-            return map.end();
+            return entries.end();
         }
 
         const_iterator begin() const {
-            return map.begin();
+            return entries.begin();
         }
 
         const_iterator end() const {
-            return map.end();
+            return entries.end();
         }
 
     };
@@ -0,0 +1,296 @@
+#include <iostream>
+#include "analysis.h"
+
+namespace StochasticSimulation {
+
+    namespace {
+        constexpr double_t tolerance = 1e-9;
+
+        // Species read by a reaction (reactants and catalysts), each once
+        std::vector<size_t> read_species(const CompiledReaction& reaction) {
+            std::vector<size_t> result{};
+            for (auto& input: reaction.inputs) {
+                result.push_back(input.species);
+            }
+            for (auto& catalyst: reaction.catalysts) {
+                result.push_back(catalyst.species);
+            }
+            std::sort(result.begin(), result.end());
+            result.erase(std::unique(result.begin(), result.end()), result.end());
+            return result;
+        }
+
+        // species id -> reactions reading it
+        std::vector<std::vector<size_t>> readers_of(const ReactionNetwork& network) {
+            std::vector<std::vector<size_t>> readers(network.species.size());
+            for (size_t r = 0; r < network.reactions.size(); ++r) {
+                for (auto species: read_species(network.reactions[r])) {
+                    readers[species].push_back(r);
+                }
+            }
+            return readers;
+        }
+
+        bool is_environment(const ReactionNetwork& network, size_t species) {
+            return network.species.key(Symbol{species}) == "__env__";
+        }
+    }
+
+    std::vector<bool> find_dead_reactions(const ReactionNetwork& network) {
+        auto reaction_count = network.reactions.size();
+        std::vector<bool> available(network.species.size(), false);
+        std::vector<bool> can_run(reaction_count, false);
+        std::vector<bool> fired(reaction_count, false);
+
+        auto amounts = network.initial_amounts();
+        for (size_t i = 0; i < amounts.size(); ++i) {
+            available[i] = amounts[i] > 0;
+        }
+        for (size_t r = 0; r < reaction_count; ++r) {
+            can_run[r] = network.reactions[r].rate > 0 && network.reactions[r].enabled;
+        }
+        for (auto& intervention: network.interventions) {
+            switch (intervention.kind) {
+                case Intervention::Kind::amount:
+                    available[intervention.target] = available[intervention.target] || intervention.value > 0;
+                    break;
+                case Intervention::Kind::rate:
+                    can_run[intervention.target] = can_run[intervention.target] || intervention.value > 0;
+                    break;
+                case Intervention::Kind::enable:
+                    can_run[intervention.target] = can_run[intervention.target] || network.reactions[intervention.target].rate > 0;
+                    break;
+                case Intervention::Kind::disable:
+                    break;
+            }
+        }
+
+        // Worklist over the reactions whose reactants and catalysts have all become available
+        auto readers = readers_of(network);
+        std::vector<size_t> missing(reaction_count);
+        std::vector<size_t> ready{};
+        for (size_t r = 0; r < reaction_count; ++r) {
+            for (auto species: read_species(network.reactions[r])) {
+                missing[r] += available[species] ? 0 : 1;
+            }
+            if (missing[r] == 0 && can_run[r]) {
+                ready.push_back(r);
+            }
+        }
+
+        while (!ready.empty()) {
+            auto r = ready.back();
+            ready.pop_back();
+            if (fired[r]) {
+                continue;
+            }
+            fired[r] = true;
+
+            for (auto& product: network.reactions[r].products) {
+                if (available[product.species]) {
+                    continue;
+                }
+                available[product.species] = true;
+                for (auto reader: readers[product.species]) {
+                    if (--missing[reader] == 0 && can_run[reader]) {
+                        ready.push_back(reader);
+                    }
+                }
+            }
+        }
+
+        std::vector<bool> dead(reaction_count);
+        for (size_t r = 0; r < reaction_count; ++r) {
+            dead[r] = !fired[r];
+        }
+        return dead;
+    }
+
+    std::vector<ConservationLaw> find_conservation_laws(const ReactionNetwork& network) {
+        // Transposed stoichiometry matrix, reactions x species, without the environment
+        std::vector<size_t> columns{};
+        for (size_t i = 0; i < network.species.size(); ++i) {
+            if (!is_environment(network, i)) {
+                columns.push_back(i);
+            }
+        }
+        auto rows = network.reactions.size();
+        auto width = columns.size();
+        std::vector<size_t> column_of(network.species.size(), width);
+        for (size_t c = 0; c < width; ++c) {
+            column_of[columns[c]] = c;
+        }
+
+        std::vector<double_t> matrix(rows * width, 0.0);
+        for (size_t r = 0; r < rows; ++r) {
+            for (auto& change: network.reactions[r].changes) {
+                if (column_of[change.species] < width) {
+                    matrix[r * width + column_of[change.species]] = change.amount;
+                }
+            }
+        }
+
+        // Reduced row echelon form with partial pivoting
+        std::vector<size_t> pivot_columns{};
+        size_t rank{0};
+        for (size_t c = 0; c < width && rank < rows; ++c) {
+            auto pivot = rank;
+            for (auto r = rank + 1; r < rows; ++r) {
+                if (std::abs(matrix[r * width + c]) > std::abs(matrix[pivot * width + c])) {
+                    pivot = r;
+                }
+            }
+            if (std::abs(matrix[pivot * width + c]) < tolerance) {
+                continue;
+            }
+            for (size_t j = 0; j < width; ++j) {
+                std::swap(matrix[rank * width + j], matrix[pivot * width + j]);
+            }
+            auto scale = matrix[rank * width + c];
+            for (size_t j = 0; j < width; ++j) {
+                matrix[rank * width + j] /= scale;
+            }
+            for (size_t r = 0; r < rows; ++r) {
+                auto factor = matrix[r * width + c];
+                if (r == rank || std::abs(factor) < tolerance) {
+                    continue;
+                }
+                for (size_t j = 0; j < width; ++j) {
+                    matrix[r * width + j] -= factor * matrix[rank * width + j];
+                }
+            }
+            pivot_columns.push_back(c);
+            rank++;
+        }
+
+        // Every free column gives one law, the free species only appears in that law
+        std::vector<bool> is_pivot(width, false);
+        for (auto c: pivot_columns) {
+            is_pivot[c] = true;
+        }
+
+        auto initial = network.initial_amounts();
+        std::vector<ConservationLaw> laws{};
+        for (size_t free = 0; free < width; ++free) {
+            if (is_pivot[free]) {
+                continue;
+            }
+
+            ConservationLaw law{{{columns[free], 1.0}}, columns[free], 0.0};
+            for (size_t i = 0; i < pivot_columns.size(); ++i) {
+                auto weight = -matrix[i * width + free];
+                if (std::abs(weight) < tolerance) {
+                    continue;
+                }
+                // Stoichiometries are integers, so are the weights up to rounding errors
+                if (std::abs(weight - std::round(weight)) < tolerance) {
+                    weight = std::round(weight);
+                }
+                law.weights.push_back({columns[pivot_columns[i]], weight});
+            }
+            std::sort(law.weights.begin(), law.weights.end(), [](const SpeciesAmount& a, const SpeciesAmount& b){ return a.species < b.species; });
+
+            for (auto& weight: law.weights) {
+                law.total += weight.amount * initial[weight.species];
+            }
+            laws.push_back(std::move(law));
+        }
+
+        return laws;
+    }
+
+    NetworkAnalysis::NetworkAnalysis(const Vessel& vessel): NetworkAnalysis(ReactionNetwork{vessel}) {}
+
+    NetworkAnalysis::NetworkAnalysis(const ReactionNetwork& network):
+        reaction_count(network.reactions.size()),
+        stoichiometry(network.species.size() * network.reactions.size(), 0.0),
+        conservation_laws(find_conservation_laws(network)),
+        dependencies(network.reactions.size()),
+        reachable(network.species.size(), false),
+        dead(find_dead_reactions(network))
+    {
+        for (auto& entry: network.species) {
+            species.push_back(entry.first);
+        }
+
+        auto readers = readers_of(network);
+        for (size_t r = 0; r < reaction_count; ++r) {
+            auto& reaction = network.reactions[r];
+            for (auto& change: reaction.changes) {
+                stoichiometry[change.species * reaction_count + r] = change.amount;
+            }
+
+            // A delayed reaction changes its reactants and its products at different times
+            std::vector<size_t> touched{};
+            for (auto& change: reaction.changes) {
+                touched.push_back(change.species);
+            }
+            if (reaction.delay.has_value()) {
+                for (auto& input: reaction.inputs) {
+                    touched.push_back(input.species);
+                }
+                for (auto& product: reaction.products) {
+                    touched.push_back(product.species);
+                }
+            }
+            for (auto species_id: touched) {
+                dependencies[r].insert(dependencies[r].end(), readers[species_id].begin(), readers[species_id].end());
+            }
+            std::sort(dependencies[r].begin(), dependencies[r].end());
+            dependencies[r].erase(std::unique(dependencies[r].begin(), dependencies[r].end()), dependencies[r].end());
+        }
+
+        // Present initially, or produced by a reaction that can fire
+        auto amounts = network.initial_amounts();
+        for (size_t i = 0; i < amounts.size(); ++i) {
+            reachable[i] = amounts[i] > 0;
+        }
+        for (auto& intervention: network.interventions) {
+            if (intervention.kind == Intervention::Kind::amount && intervention.value > 0) {
+                reachable[intervention.target] = true;
+            }
+        }
+        for (size_t r = 0; r < reaction_count; ++r) {
+            if (!dead[r]) {
+                for (auto& product: network.reactions[r].products) {
+                    reachable[product.species] = true;
+                }
+            }
+        }
+    }
+
+    std::ostream& operator<<(std::ostream& s, const NetworkAnalysis& analysis) {
+        s << "Species: " << analysis.species.size() << ", reactions: " << analysis.reaction_count << std::endl;
+
+        s << "Conservation laws:" << std::endl;
+        for (auto& law: analysis.conservation_laws) {
+            s << "\t";
+            for (auto& weight: law.weights) {
+                if (&weight != &law.weights.front()) {
+                    s << (weight.amount < 0 ? " - " : " + ");
+                } else if (weight.amount < 0) {
+                    s << "-";
+                }
+                if (std::abs(weight.amount) != 1) {
+                    s << std::abs(weight.amount) << "*";
+                }
+                s << analysis.species[weight.species];
+            }
+            s << " = " << law.total << std::endl;
+        }
+
+        s << "Dead reactions:";
+        for (size_t r = 0; r < analysis.reaction_count; ++r) {
+            if (analysis.dead[r]) {
+                s << " " << r;
+            }
+        }
+        s << std::endl << "Unreachable species:";
+        for (size_t i = 0; i < analysis.species.size(); ++i) {
+            if (!analysis.reachable[i] && analysis.species[i] != "__env__") {
+                s << " " << analysis.species[i];
+            }
+        }
+        return s << std::endl;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef SP_EXAM_PROJECT_ANALYSIS_H
+#define SP_EXAM_PROJECT_ANALYSIS_H
+
+#include "network.h"
+
+namespace StochasticSimulation {
+
+    // Weighted sum of amounts that no reaction changes, such as DA + D_A in the circadian oscillator
+    struct ConservationLaw {
+        std::vector<SpeciesAmount> weights;
+        size_t dependent;  // species with weight 1 appearing in no other law, it can be computed from the others
+        double_t total;    // value of the sum for the initial amounts
+    };
+
+    // Reactions that can never fire: some reactant or catalyst can never be present, or the rate is 0
+    // and never changed. Scheduled amount, rate and enable interventions are taken into account.
+    std::vector<bool> find_dead_reactions(const ReactionNetwork& network);
+
+    // Basis of the conserved quantities, the left null space of the stoichiometry matrix. The environment is left out.
+    std::vector<ConservationLaw> find_conservation_laws(const ReactionNetwork& network);
+
+    // Static analysis of a network, meant for inspecting a model. The engines only use the parts they
+    // need through the functions above, the dense stoichiometry matrix is too large for big networks.
+    class NetworkAnalysis {
+    public:
+        std::vector<std::string> species{};                 // names by species id
+        size_t reaction_count{0};
+        std::vector<double_t> stoichiometry{};              // row-major species x reactions net changes
+        std::vector<ConservationLaw> conservation_laws{};
+        std::vector<std::vector<size_t>> dependencies{};    // reaction -> reactions whose propensity it may change
+        std::vector<bool> reachable{};                      // species that can ever be present
+        std::vector<bool> dead{};                           // reactions that can never fire
+
+        explicit NetworkAnalysis(const ReactionNetwork& network);
+        explicit NetworkAnalysis(const Vessel& vessel);
+
+        [[nodiscard]] double_t change(size_t species_id, size_t reaction) const {
+            return stoichiometry[species_id * reaction_count + reaction];
+        }
+
+        friend std::ostream& operator<<(std::ostream& s, const NetworkAnalysis& analysis);
+    };
+}
+
+#endif //SP_EXAM_PROJECT_ANALYSIS_H
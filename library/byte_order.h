@@ -0,0 +1,38 @@
+#ifndef SP_EXAM_PROJECT_BYTE_ORDER_H
+#define SP_EXAM_PROJECT_BYTE_ORDER_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace StochasticSimulation {
+
+    template<size_t Size> struct unsigned_of;
+    template<> struct unsigned_of<1> { using type = uint8_t; };
+    template<> struct unsigned_of<2> { using type = uint16_t; };
+    template<> struct unsigned_of<4> { using type = uint32_t; };
+    template<> struct unsigned_of<8> { using type = uint64_t; };
+
+    // Fixed size values in files are little-endian whatever the byte order of the machine
+    template<typename T>
+    void put_little_endian(std::vector<uint8_t>& out, T value) {
+        auto bits = std::bit_cast<typename unsigned_of<sizeof(T)>::type>(value);
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            out.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+        }
+    }
+
+    // Reads sizeof(T) bytes, the caller checks they are there
+    template<typename T>
+    T get_little_endian(const uint8_t* bytes) {
+        using Bits = typename unsigned_of<sizeof(T)>::type;
+        Bits bits{0};
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            bits |= static_cast<Bits>(static_cast<Bits>(bytes[i]) << (8 * i));
+        }
+        return std::bit_cast<T>(bits);
+    }
+}
+
+#endif //SP_EXAM_PROJECT_BYTE_ORDER_H
@@ -0,0 +1,259 @@
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <random>
+#include "byte_order.h"
+#include "cache.h"
+
+namespace StochasticSimulation {
+
+    namespace {
+        constexpr uint32_t magic = 0x43455353;  // "SSEC"
+        constexpr uint32_t format_version = 3;
+        constexpr auto extension = ".ensemble";
+
+        void put_values(std::vector<uint8_t>& out, const std::vector<double_t>& values) {
+            put_little_endian(out, static_cast<uint64_t>(values.size()));
+            for (auto value: values) {
+                put_little_endian(out, value);
+            }
+        }
+
+        // Bounds checked reading of an entry, every length is checked against the bytes left before
+        // anything is allocated for it
+        class EntryReader {
+        private:
+            const uint8_t* position;
+            const uint8_t* end;
+        public:
+            EntryReader(const uint8_t* begin, const uint8_t* end): position(begin), end(end) {}
+
+            [[nodiscard]] size_t remaining() const {
+                return static_cast<size_t>(end - position);
+            }
+
+            template<typename T>
+            bool read(T& value) {
+                if (remaining() < sizeof(T)) {
+                    return false;
+                }
+                value = get_little_endian<T>(position);
+                position += sizeof(T);
+                return true;
+            }
+
+            bool read(std::string& text, uint64_t length) {
+                if (remaining() < length) {
+                    return false;
+                }
+                text.assign(reinterpret_cast<const char*>(position), length);
+                position += length;
+                return true;
+            }
+
+            bool read(std::vector<double_t>& values, uint64_t expected) {
+                uint64_t size{0};
+                if (!read(size) || size != expected || remaining() / sizeof(double_t) < size) {
+                    return false;
+                }
+                values.resize(size);
+                for (auto& value: values) {
+                    read(value);
+                }
+                return true;
+            }
+        };
+
+        uint64_t random_suffix() {
+            std::random_device device{};
+            return (static_cast<uint64_t>(device()) << 32) | device();
+        }
+
+        void hash_amounts(ContentHash& hash, const std::vector<SpeciesAmount>& amounts) {
+            hash.add(amounts.size());
+            for (auto& amount: amounts) {
+                hash.add(amount.species);
+                hash.add(amount.amount);
+            }
+        }
+    }
+
+    void ContentHash::add(const void* data, size_t size) {
+        auto* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    }
+
+    uint64_t ensemble_key(const ReactionNetwork& network, double_t end_time, size_t simulations,
+                          size_t grid_points, SsaEngine selection, uint64_t seed) {
+        ContentHash hash{};
+        hash.add(format_version);
+
+        hash.add(network.species.size());
+        for (auto& [name, reactant]: network.species) {
+            hash.add(std::string_view{name});
+            hash.add(reactant.amount);
+        }
+
+        hash.add(network.reactions.size());
+        for (auto& reaction: network.reactions) {
+            hash_amounts(hash, reaction.inputs);
+            hash_amounts(hash, reaction.catalysts);
+            hash_amounts(hash, reaction.changes);
+            hash_amounts(hash, reaction.products);
+            hash.add(reaction.rate);
+            hash.add(reaction.enabled);
+            hash.add(reaction.delay.has_value());
+            if (reaction.delay.has_value()) {
+                hash.add(reaction.delay->distribution);
+                hash.add(reaction.delay->first);
+                hash.add(reaction.delay->second);
+            }
+        }
+
+        hash.add(network.interventions.size());
+        for (auto& intervention: network.interventions) {
+            hash.add(intervention.time);
+            hash.add(intervention.kind);
+            hash.add(intervention.target);
+            hash.add(intervention.value);
+        }
+
+        // Every run has its own random stream, so the number of processes does not change the result
+        hash.add(end_time);
+        hash.add(simulations);
+        hash.add(grid_points);
+        hash.add(selection);
+        hash.add(seed);
+        return hash.value();
+    }
+
+    EnsembleCache::EnsembleCache(std::filesystem::path directory, uintmax_t max_bytes):
+        directory(std::move(directory)),
+        max_bytes(max_bytes)
+    {
+        std::filesystem::create_directories(this->directory);
+    }
+
+    std::filesystem::path EnsembleCache::path_of(uint64_t key) const {
+        std::stringstream name;
+        name << std::hex << std::setw(16) << std::setfill('0') << key << extension;
+        return directory / name.str();
+    }
+
+    std::optional<EnsembleStatistics> EnsembleCache::load(uint64_t key) const {
+        auto path = path_of(key);
+        std::error_code error;
+        auto bytes = std::filesystem::file_size(path, error);
+        std::ifstream file{path, std::ios::binary};
+        if (error || !file) {
+            return std::nullopt;
+        }
+        std::vector<uint8_t> data(static_cast<size_t>(bytes));
+        if (!file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()))) {
+            return std::nullopt;
+        }
+        EntryReader reader{data.data(), data.data() + data.size()};
+
+        uint32_t file_magic{0}, file_version{0};
+        uint64_t file_key{0}, species_count{0}, time_count{0}, runs{0};
+        if (!reader.read(file_magic) || !reader.read(file_version) || !reader.read(file_key) ||
+            file_magic != magic || file_version != format_version || file_key != key || !reader.read(species_count)) {
+            return std::nullopt;
+        }
+
+        EnsembleStatistics statistics{};
+        for (uint64_t i = 0; i < species_count; ++i) {
+            uint64_t length{0};
+            double_t amount{0};
+            std::string name{};
+            if (!reader.read(length) || !reader.read(amount) || !reader.read(name, length) || statistics.species.contains(name)) {
+                return std::nullopt;
+            }
+            statistics.species.put(name, Reactant{name, amount});
+        }
+
+        if (!reader.read(runs) || !reader.read(time_count) || !reader.read(statistics.times, time_count) ||
+            (species_count != 0 && time_count > std::numeric_limits<uint64_t>::max() / species_count) ||
+            !reader.read(statistics.mean, time_count * species_count) ||
+            !reader.read(statistics.variance, time_count * species_count)) {
+            return std::nullopt;
+        }
+        statistics.runs = runs;
+        statistics.requested = runs;
+
+        // Marks the entry as recently used for the eviction
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+        return statistics;
+    }
+
+    void EnsembleCache::store(uint64_t key, const EnsembleStatistics& statistics) const {
+        auto path = path_of(key);
+        std::stringstream temporary_name;
+        // Processes sharing the directory may store the same entry at once, each writes its own file
+        temporary_name << path.filename().string() << "." << random_suffix() << ".tmp";
+        auto temporary = directory / temporary_name.str();
+
+        std::vector<uint8_t> entry{};
+        put_little_endian(entry, magic);
+        put_little_endian(entry, format_version);
+        put_little_endian(entry, key);
+        put_little_endian(entry, static_cast<uint64_t>(statistics.species.size()));
+        for (auto& [name, reactant]: statistics.species) {
+            put_little_endian(entry, static_cast<uint64_t>(name.size()));
+            put_little_endian(entry, reactant.amount);
+            entry.insert(entry.end(), name.begin(), name.end());
+        }
+        put_little_endian(entry, static_cast<uint64_t>(statistics.runs));
+        put_little_endian(entry, static_cast<uint64_t>(statistics.times.size()));
+        put_values(entry, statistics.times);
+        put_values(entry, statistics.mean);
+        put_values(entry, statistics.variance);
+
+        {
+            std::ofstream file{temporary, std::ios::binary | std::ios::trunc};
+            file.write(reinterpret_cast<const char*>(entry.data()), static_cast<std::streamsize>(entry.size()));
+            if (!file) {
+                std::filesystem::remove(temporary);
+                throw std::runtime_error("Could not write cache entry " + temporary.string());
+            }
+        }
+
+        std::filesystem::rename(temporary, path);
+        evict();
+    }
+
+    uintmax_t EnsembleCache::size() const {
+        uintmax_t total{0};
+        for (auto& entry: std::filesystem::directory_iterator(directory)) {
+            if (entry.is_regular_file() && entry.path().extension() == extension) {
+                total += entry.file_size();
+            }
+        }
+        return total;
+    }
+
+    void EnsembleCache::evict() const {
+        std::vector<std::filesystem::directory_entry> entries{};
+        uintmax_t total{0};
+        for (auto& entry: std::filesystem::directory_iterator(directory)) {
+            if (entry.is_regular_file() && entry.path().extension() == extension) {
+                entries.push_back(entry);
+                total += entry.file_size();
+            }
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b){ return a.last_write_time() < b.last_write_time(); });
+        for (auto& entry: entries) {
+            if (total <= max_bytes) {
+                break;
+            }
+            total -= entry.file_size();
+            std::error_code error;
+            std::filesystem::remove(entry.path(), error);
+        }
+    }
+}
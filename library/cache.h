@@ -0,0 +1,57 @@
+#ifndef SP_EXAM_PROJECT_CACHE_H
+#define SP_EXAM_PROJECT_CACHE_H
+
+#include <filesystem>
+#include "network.h"
+
+namespace StochasticSimulation {
+
+    // Incremental 64 bit FNV-1a hash over the bytes of the values added
+    class ContentHash {
+    private:
+        uint64_t hash{14695981039346656037ull};
+    public:
+        void add(const void* data, size_t size);
+
+        template<typename T> requires std::is_arithmetic_v<T> || std::is_enum_v<T>
+        void add(T value) {
+            add(&value, sizeof(value));
+        }
+
+        void add(std::string_view text) {
+            add(text.size());
+            add(text.data(), text.size());
+        }
+
+        [[nodiscard]] uint64_t value() const {
+            return hash;
+        }
+    };
+
+    // Key of a process ensemble: everything its result depends on. Amounts, rates, delays and interventions
+    // are hashed as compiled, so vessels built in a different order but with the same ids give the same key.
+    uint64_t ensemble_key(const ReactionNetwork& network, double_t end_time, size_t simulations,
+                          size_t grid_points, SsaEngine selection, uint64_t seed);
+
+    // Directory of ensemble statistics stored under their key. When the files take up more than max_bytes
+    // the least recently used are removed. Entries that cannot be read are treated as missing.
+    class EnsembleCache {
+    private:
+        std::filesystem::path directory;
+        uintmax_t max_bytes;
+
+        [[nodiscard]] std::filesystem::path path_of(uint64_t key) const;
+        void evict() const;
+    public:
+        explicit EnsembleCache(std::filesystem::path directory, uintmax_t max_bytes = uintmax_t{1} << 30);
+
+        [[nodiscard]] std::optional<EnsembleStatistics> load(uint64_t key) const;
+
+        // Written to a temporary file first, so a concurrent load never sees a partial entry
+        void store(uint64_t key, const EnsembleStatistics& statistics) const;
+
+        [[nodiscard]] uintmax_t size() const;
+    };
+}
+
+#endif //SP_EXAM_PROJECT_CACHE_H
@@ -0,0 +1,503 @@
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include "byte_order.h"
+#include "codec.h"
+
+namespace StochasticSimulation {
+
+    namespace {
+        constexpr char magic[4] = {'S', 'S', 'T', 'C'};
+        constexpr uint32_t format_version = 2;
+        constexpr double_t largest_exact_integer = 9007199254740992.0;  // 2^53
+
+        enum class BlockMode: uint8_t {
+            integral,  // first row in full, then time deltas and the changed columns as zigzag varints
+            raw        // times and amounts as doubles
+        };
+
+        template<typename T>
+        void put_fixed(std::vector<uint8_t>& out, T value) {
+            put_little_endian(out, value);
+        }
+
+        constexpr auto crc_table = []() {
+            std::array<uint32_t, 256> table{};
+            for (uint32_t i = 0; i < table.size(); ++i) {
+                auto crc = i;
+                for (int bit = 0; bit < 8; ++bit) {
+                    crc = crc & 1 ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+                }
+                table[i] = crc;
+            }
+            return table;
+        }();
+
+        // CRC-32 (the polynomial of zlib), crc continues the checksum of earlier bytes
+        uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+            crc = ~crc;
+            for (size_t i = 0; i < size; ++i) {
+                crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+
+        void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+            while (value >= 0x80) {
+                out.push_back(static_cast<uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<uint8_t>(value));
+        }
+
+        void put_varint(std::string& out, uint64_t value) {
+            while (value >= 0x80) {
+                out.push_back(static_cast<char>(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        // Small magnitudes of either sign become small unsigned numbers: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+        uint64_t zigzag(int64_t value) {
+            return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        }
+
+        int64_t unzigzag(uint64_t value) {
+            return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+
+        // Difference without signed overflow, wraps around like the sum in the decoder
+        int64_t difference(int64_t value, int64_t previous) {
+            return static_cast<int64_t>(static_cast<uint64_t>(value) - static_cast<uint64_t>(previous));
+        }
+
+        int64_t sum(int64_t previous, int64_t delta) {
+            return static_cast<int64_t>(static_cast<uint64_t>(previous) + static_cast<uint64_t>(delta));
+        }
+
+        bool is_integral(double_t amount) {
+            return std::abs(amount) < largest_exact_integer && amount == std::nearbyint(amount);
+        }
+
+        // Bounds checked reading of the archive
+        class Reader {
+        private:
+            const uint8_t* position;
+            const uint8_t* end;
+
+            static void corrupt() {
+                throw std::runtime_error("Corrupt compressed trajectory");
+            }
+        public:
+            Reader(const uint8_t* begin, const uint8_t* end): position(begin), end(end) {}
+
+            template<typename T>
+            T fixed() {
+                if (static_cast<size_t>(end - position) < sizeof(T)) {
+                    corrupt();
+                }
+                auto value = get_little_endian<T>(position);
+                position += sizeof(T);
+                return value;
+            }
+
+            uint64_t varint() {
+                uint64_t value{0};
+                for (int shift = 0; shift < 64; shift += 7) {
+                    if (position == end) {
+                        corrupt();
+                    }
+                    auto byte = *position++;
+                    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                    if ((byte & 0x80) == 0) {
+                        return value;
+                    }
+                }
+                corrupt();
+                return value;
+            }
+
+            std::string_view bytes(size_t size) {
+                if (static_cast<size_t>(end - position) < size) {
+                    corrupt();
+                }
+                std::string_view result{reinterpret_cast<const char*>(position), size};
+                position += size;
+                return result;
+            }
+        };
+
+        // Calls body(i) for every i below n, split into contiguous blocks over async workers
+        void parallel_for(size_t n, size_t threads, const std::function<void(size_t)>& body) {
+            auto jobs = threads == 0 ? std::max<size_t>(1, std::thread::hardware_concurrency()) : threads;
+            jobs = std::max<size_t>(1, std::min(jobs, n));
+
+            auto futures = std::vector<std::future<void>>{};
+            for (size_t job = 0; job < jobs; ++job) {
+                futures.push_back(std::async(std::launch::async, [&body, begin = n * job / jobs, end = n * (job + 1) / jobs]() {
+                    for (auto i = begin; i < end; ++i) {
+                        body(i);
+                    }
+                }));
+            }
+            for (auto& future: futures) {
+                future.get();
+            }
+        }
+    }
+
+    TrajectoryEncoder::TrajectoryEncoder(const std::string& path, SymbolTable<Reactant> layout, const TrajectoryCodecOptions& options):
+        file(path, std::ios::binary | std::ios::trunc),
+        layout(std::move(layout)),
+        options(options)
+    {
+        if (!file) {
+            throw std::runtime_error("Could not open " + path + " for writing");
+        }
+        if (options.block_rows == 0 || options.time_resolution < 0) {
+            throw std::invalid_argument("Blocks need at least one row and the time resolution cannot be negative");
+        }
+
+        std::vector<uint8_t> header{};
+        header.insert(header.end(), std::begin(magic), std::end(magic));
+        put_fixed(header, format_version);
+        put_fixed(header, options.time_resolution);
+        put_varint(header, this->layout.size());
+        for (auto& [name, reactant]: this->layout) {
+            put_varint(header, name.size());
+            header.insert(header.end(), name.begin(), name.end());
+            put_fixed(header, reactant.amount);
+        }
+        file.write(reinterpret_cast<const char*>(header.data()), static_cast<std::streamsize>(header.size()));
+
+        block_times.reserve(options.block_rows);
+        block_amounts.reserve(options.block_rows * this->layout.size());
+    }
+
+    TrajectoryEncoder::~TrajectoryEncoder() {
+        try {
+            finish();
+        } catch (...) {
+            // A destructor cannot report the failure, call finish() to see it
+        }
+    }
+
+    int64_t TrajectoryEncoder::time_value(double_t time) const {
+        if (options.time_resolution > 0) {
+            auto value = std::round(time / options.time_resolution);
+            if (!(std::abs(value) < 9223372036854775808.0)) {  // 2^63
+                throw std::out_of_range("Time does not fit the time resolution of the trajectory");
+            }
+            return static_cast<int64_t>(value);
+        }
+        int64_t bits;
+        std::memcpy(&bits, &time, sizeof(bits));
+        return bits;
+    }
+
+    void TrajectoryEncoder::add(double_t time, std::span<const double_t> amounts) {
+        if (finished) {
+            throw std::logic_error("Rows cannot be added to a finished trajectory");
+        }
+        if (amounts.size() != layout.size()) {
+            throw std::invalid_argument("Row does not have an amount for every species");
+        }
+
+        block_times.push_back(time);
+        block_amounts.insert(block_amounts.end(), amounts.begin(), amounts.end());
+        if (block_times.size() == options.block_rows) {
+            flush();
+        }
+    }
+
+    void TrajectoryEncoder::flush() {
+        if (block_times.empty()) {
+            return;
+        }
+
+        auto width = layout.size();
+        auto row_count = block_times.size();
+        auto mode = std::all_of(block_amounts.begin(), block_amounts.end(), is_integral) ? BlockMode::integral : BlockMode::raw;
+
+        payload.clear();
+        if (mode == BlockMode::raw) {
+            for (size_t row = 0; row < row_count; ++row) {
+                put_fixed(payload, block_times[row]);
+                for (size_t i = 0; i < width; ++i) {
+                    put_fixed(payload, block_amounts[row * width + i]);
+                }
+            }
+        } else {
+            auto previous_time = time_value(block_times[0]);
+            put_varint(payload, zigzag(previous_time));
+            for (size_t i = 0; i < width; ++i) {
+                put_varint(payload, zigzag(static_cast<int64_t>(block_amounts[i])));
+            }
+
+            patterns.clear();
+            for (size_t row = 1; row < row_count; ++row) {
+                auto time = time_value(block_times[row]);
+                put_varint(payload, zigzag(difference(time, previous_time)));
+                previous_time = time;
+
+                // The changed columns as (gap to the previous changed column, change) pairs
+                auto* current = block_amounts.data() + row * width;
+                auto* previous = current - width;
+                size_t changed{0};
+                pattern.clear();
+                for (size_t i = 0; i < width; ++i) {
+                    changed += current[i] != previous[i] ? 1 : 0;
+                }
+                put_varint(pattern, changed);
+                size_t last_column{0};
+                for (size_t i = 0; i < width; ++i) {
+                    if (current[i] != previous[i]) {
+                        put_varint(pattern, i - last_column);
+                        put_varint(pattern, zigzag(static_cast<int64_t>(current[i]) - static_cast<int64_t>(previous[i])));
+                        last_column = i;
+                    }
+                }
+
+                auto [entry, inserted] = patterns.try_emplace(pattern, patterns.size());
+                put_varint(payload, entry->second);
+                if (inserted) {
+                    payload.insert(payload.end(), pattern.begin(), pattern.end());
+                }
+            }
+        }
+
+        std::vector<uint8_t> block_header{};
+        put_fixed(block_header, static_cast<uint8_t>(mode));
+        put_varint(block_header, row_count);
+        put_varint(block_header, payload.size());
+        // The checksum covers the block header and the payload
+        std::vector<uint8_t> checksum{};
+        put_fixed(checksum, crc32(payload.data(), payload.size(), crc32(block_header.data(), block_header.size())));
+
+        index.push_back({static_cast<uint64_t>(file.tellp()), rows, row_count, block_times.front(), block_times.back()});
+        file.write(reinterpret_cast<const char*>(block_header.data()), static_cast<std::streamsize>(block_header.size()));
+        file.write(reinterpret_cast<const char*>(payload.data()), static_cast<std::streamsize>(payload.size()));
+        file.write(reinterpret_cast<const char*>(checksum.data()), static_cast<std::streamsize>(checksum.size()));
+
+        rows += row_count;
+        block_times.clear();
+        block_amounts.clear();
+    }
+
+    void TrajectoryEncoder::finish() {
+        if (finished) {
+            return;
+        }
+        finished = true;
+        flush();
+
+        std::vector<uint8_t> footer{};
+        auto index_offset = static_cast<uint64_t>(file.tellp());
+        for (auto& entry: index) {
+            put_fixed(footer, entry.offset);
+            put_fixed(footer, entry.first_row);
+            put_fixed(footer, entry.rows);
+            put_fixed(footer, entry.first_time);
+            put_fixed(footer, entry.last_time);
+        }
+        put_fixed(footer, static_cast<uint64_t>(index.size()));
+        put_fixed(footer, index_offset);
+        footer.insert(footer.end(), std::begin(magic), std::end(magic));
+        file.write(reinterpret_cast<const char*>(footer.data()), static_cast<std::streamsize>(footer.size()));
+
+        file.close();
+        if (file.fail()) {
+            throw std::runtime_error("Could not write the compressed trajectory");
+        }
+    }
+
+    compressing_simulation_monitor::compressing_simulation_monitor(TrajectoryEncoder& encoder):
+        encoder(encoder),
+        row(encoder.species().size())
+    {
+        for (size_t i = 0; i < row.size(); ++i) {
+            row[i] = encoder.species()[Symbol{i}].amount;
+        }
+        encoder.add(0, row);
+    }
+
+    void compressing_simulation_monitor::monitor(SimulationState& state) {
+        for (size_t i = 0; i < row.size(); ++i) {
+            row[i] = state.reactants[Symbol{i}].amount;
+        }
+        encoder.add(state.time, row);
+    }
+
+    TrajectoryArchive::TrajectoryArchive(const std::string& path) {
+        std::ifstream file{path, std::ios::binary | std::ios::ate};
+        if (!file) {
+            throw std::runtime_error("Could not open " + path);
+        }
+        data.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+
+        Reader header{data.data(), data.data() + data.size()};
+        if (header.bytes(sizeof(magic)) != std::string_view{magic, sizeof(magic)} || header.fixed<uint32_t>() != format_version) {
+            throw std::runtime_error(path + " is not a compressed trajectory of this version");
+        }
+        time_resolution = header.fixed<double_t>();
+        auto width = header.varint();
+        for (uint64_t i = 0; i < width; ++i) {
+            auto name = std::string{header.bytes(header.varint())};
+            layout.put(name, Reactant{name, header.fixed<double_t>()});
+        }
+
+        // The footer is the block count, the offset of the index and the magic bytes
+        auto footer_size = 2 * sizeof(uint64_t) + sizeof(magic);
+        if (data.size() < footer_size) {
+            throw std::runtime_error(path + " is truncated");
+        }
+        Reader footer{data.data() + data.size() - footer_size, data.data() + data.size()};
+        auto count = footer.fixed<uint64_t>();
+        auto index_offset = footer.fixed<uint64_t>();
+        if (footer.bytes(sizeof(magic)) != std::string_view{magic, sizeof(magic)} || index_offset > data.size() - footer_size) {
+            throw std::runtime_error(path + " is truncated");
+        }
+
+        Reader index{data.data() + index_offset, data.data() + data.size() - footer_size};
+        for (uint64_t i = 0; i < count; ++i) {
+            Block block{};
+            block.offset = index.fixed<uint64_t>();
+            block.first_row = index.fixed<uint64_t>();
+            block.rows = index.fixed<uint64_t>();
+            block.first_time = index.fixed<double_t>();
+            block.last_time = index.fixed<double_t>();
+            if (block.offset >= index_offset || block.first_row != rows) {
+                throw std::runtime_error("Corrupt compressed trajectory");
+            }
+            rows += block.rows;
+            blocks.push_back(block);
+        }
+    }
+
+    void TrajectoryArchive::decode_block(size_t block, double_t* times, double_t* amounts) const {
+        auto width = layout.size();
+        auto* start = data.data() + blocks[block].offset;
+        Reader reader{start, data.data() + data.size()};
+        auto mode = static_cast<BlockMode>(reader.fixed<uint8_t>());
+        auto row_count = reader.varint();
+        auto payload_size = reader.varint();
+        if (row_count != blocks[block].rows) {
+            throw std::runtime_error("Corrupt compressed trajectory");
+        }
+        auto bytes = reader.bytes(payload_size);
+        auto* begin = reinterpret_cast<const uint8_t*>(bytes.data());
+        if (reader.fixed<uint32_t>() != crc32(start, static_cast<size_t>(begin - start) + bytes.size())) {
+            throw std::runtime_error("Corrupt compressed trajectory, block " + std::to_string(block) + " fails its checksum");
+        }
+        Reader payload{begin, begin + bytes.size()};
+
+        if (mode == BlockMode::raw) {
+            for (size_t row = 0; row < row_count; ++row) {
+                times[row] = payload.fixed<double_t>();
+                for (size_t i = 0; i < width; ++i) {
+                    amounts[row * width + i] = payload.fixed<double_t>();
+                }
+            }
+            return;
+        }
+        if (mode != BlockMode::integral) {
+            throw std::runtime_error("Corrupt compressed trajectory");
+        }
+
+        auto to_time = [this](int64_t value) {
+            if (time_resolution > 0) {
+                return static_cast<double_t>(value) * time_resolution;
+            }
+            double_t time;
+            std::memcpy(&time, &value, sizeof(time));
+            return time;
+        };
+
+        auto time = unzigzag(payload.varint());
+        times[0] = to_time(time);
+        for (size_t i = 0; i < width; ++i) {
+            amounts[i] = static_cast<double_t>(unzigzag(payload.varint()));
+        }
+
+        // Changes by pattern number, flattened as (column, change) pairs
+        std::vector<size_t> pattern_start{};
+        std::vector<std::pair<size_t, double_t>> changes{};
+        for (size_t row = 1; row < row_count; ++row) {
+            time = sum(time, unzigzag(payload.varint()));
+            times[row] = to_time(time);
+
+            auto id = payload.varint();
+            if (id == pattern_start.size()) {
+                pattern_start.push_back(changes.size());
+                auto changed = payload.varint();
+                size_t column{0};
+                for (uint64_t c = 0; c < changed; ++c) {
+                    column += payload.varint();
+                    if (column >= width) {
+                        throw std::runtime_error("Corrupt compressed trajectory");
+                    }
+                    changes.emplace_back(column, static_cast<double_t>(unzigzag(payload.varint())));
+                }
+            } else if (id > pattern_start.size()) {
+                throw std::runtime_error("Corrupt compressed trajectory");
+            }
+
+            auto* current = amounts + row * width;
+            std::copy(current - width, current, current);
+            auto end = id + 1 < pattern_start.size() ? pattern_start[id + 1] : changes.size();
+            for (auto c = pattern_start[id]; c < end; ++c) {
+                current[changes[c].first] += changes[c].second;
+            }
+        }
+    }
+
+    SimulationTrajectory TrajectoryArchive::decode_blocks(size_t first, size_t last, size_t threads) const {
+        if (first >= last) {
+            return SimulationTrajectory{layout};
+        }
+
+        auto width = layout.size();
+        auto first_row = blocks[first].first_row;
+        auto row_count = blocks[last - 1].first_row + blocks[last - 1].rows - first_row;
+        std::vector<double_t> times(row_count);
+        std::vector<double_t> amounts(row_count * width);
+
+        parallel_for(last - first, threads, [&](size_t i) {
+            auto& block = blocks[first + i];
+            auto offset = block.first_row - first_row;
+            decode_block(first + i, times.data() + offset, amounts.data() + offset * width);
+        });
+
+        return SimulationTrajectory{layout, std::move(times), std::move(amounts)};
+    }
+
+    SimulationTrajectory TrajectoryArchive::read(size_t threads) const {
+        return decode_blocks(0, blocks.size(), threads);
+    }
+
+    SimulationTrajectory TrajectoryArchive::read(double_t from, double_t to, size_t threads) const {
+        auto first = static_cast<size_t>(std::partition_point(blocks.begin(), blocks.end(), [from](const Block& block){ return block.last_time < from; }) - blocks.begin());
+        auto last = static_cast<size_t>(std::partition_point(blocks.begin(), blocks.end(), [to](const Block& block){ return block.first_time <= to; }) - blocks.begin());
+        auto decoded = decode_blocks(first, std::max(first, last), threads);
+
+        // The first and last block can reach outside the window
+        SimulationTrajectory result{layout};
+        auto window = decoded.window(from, to);
+        result.reserve(window.size());
+        for (auto point: window) {
+            result.insert(point.time, point.amounts);
+        }
+        return result;
+    }
+
+    void write_compressed(const SimulationTrajectory& trajectory, const std::string& path, const TrajectoryCodecOptions& options) {
+        TrajectoryEncoder encoder{path, trajectory.species(), options};
+        for (auto point: trajectory) {
+            encoder.add(point.time, point.amounts);
+        }
+        encoder.finish();
+    }
+}
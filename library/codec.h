@@ -0,0 +1,122 @@
+#ifndef SP_EXAM_PROJECT_CODEC_H
+#define SP_EXAM_PROJECT_CODEC_H
+
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include "simulation.h"
+
+namespace StochasticSimulation {
+
+    struct TrajectoryCodecOptions {
+        size_t block_rows{4096};      // rows per block, the unit of seeking and of parallel decoding
+        // 0 keeps times exact. Otherwise times are rounded to multiples of this, which about doubles the
+        // compression of event trajectories.
+        double_t time_resolution{0};
+    };
+
+    // Writes a compressed trajectory one row at a time. Rows are gathered in blocks; a block of integral
+    // amounts stores the first row in full and then per row the time delta and the columns that changed,
+    // as zigzag varints. Each distinct set of changes (usually one per reaction) is stored once per block and
+    // referred to by number afterwards. Blocks with other amounts are stored as raw doubles. Every block ends
+    // with a CRC-32 checked when it is decoded, and an index of the blocks is written at the end by finish().
+    // Fixed size values are little-endian, so archives can be read on any machine.
+    class TrajectoryEncoder {
+    private:
+        std::ofstream file;
+        SymbolTable<Reactant> layout;
+        TrajectoryCodecOptions options;
+
+        std::vector<double_t> block_times{};
+        std::vector<double_t> block_amounts{};
+        std::vector<uint8_t> payload{};
+        std::string pattern{};
+        std::unordered_map<std::string, size_t> patterns{};
+
+        struct BlockEntry {
+            uint64_t offset;
+            uint64_t first_row;
+            uint64_t rows;
+            double_t first_time;
+            double_t last_time;
+        };
+        std::vector<BlockEntry> index{};
+        uint64_t rows{0};
+        bool finished{false};
+
+        [[nodiscard]] int64_t time_value(double_t time) const;
+        void flush();
+    public:
+        TrajectoryEncoder(const std::string& path, SymbolTable<Reactant> layout, const TrajectoryCodecOptions& options = {});
+        ~TrajectoryEncoder();
+
+        TrajectoryEncoder(const TrajectoryEncoder&) = delete;
+        TrajectoryEncoder& operator=(const TrajectoryEncoder&) = delete;
+
+        void add(double_t time, std::span<const double_t> amounts);
+
+        // Writes the last block and the index, called by the destructor if not called before
+        void finish();
+
+        [[nodiscard]] const SymbolTable<Reactant>& species() const {
+            return layout;
+        }
+    };
+
+    // Encodes the states of a simulation while it runs. The simulations insert their initial state without
+    // calling the monitor, so the amounts of the layout of the encoder are added at time 0 on construction.
+    class compressing_simulation_monitor: public simulation_monitor {
+    private:
+        TrajectoryEncoder& encoder;
+        std::vector<double_t> row;
+    public:
+        explicit compressing_simulation_monitor(TrajectoryEncoder& encoder);
+
+        void monitor(SimulationState& state) override;
+    };
+
+    // Compressed trajectory loaded into memory, blocks are decoded on demand
+    class TrajectoryArchive {
+    private:
+        std::vector<uint8_t> data{};
+        SymbolTable<Reactant> layout{};
+        double_t time_resolution{0};
+
+        struct Block {
+            uint64_t offset;
+            uint64_t first_row;
+            uint64_t rows;
+            double_t first_time;
+            double_t last_time;
+        };
+        std::vector<Block> blocks{};
+        uint64_t rows{0};
+
+        void decode_block(size_t block, double_t* times, double_t* amounts) const;
+        [[nodiscard]] SimulationTrajectory decode_blocks(size_t first, size_t last, size_t threads) const;
+    public:
+        explicit TrajectoryArchive(const std::string& path);
+
+        [[nodiscard]] size_t size() const {
+            return rows;
+        }
+
+        [[nodiscard]] size_t block_count() const {
+            return blocks.size();
+        }
+
+        [[nodiscard]] const SymbolTable<Reactant>& species() const {
+            return layout;
+        }
+
+        // Every row, the blocks are decoded in parallel. threads 0 uses one per core.
+        [[nodiscard]] SimulationTrajectory read(size_t threads = 0) const;
+
+        // Rows with from <= time <= to, only the blocks overlapping the window are decoded
+        [[nodiscard]] SimulationTrajectory read(double_t from, double_t to, size_t threads = 0) const;
+    };
+
+    void write_compressed(const SimulationTrajectory& trajectory, const std::string& path, const TrajectoryCodecOptions& options = {});
+}
+
+#endif //SP_EXAM_PROJECT_CODEC_H
@@ -5,6 +5,8 @@
 #ifndef SP_EXAM_PROJECT_DATA_H
 #define SP_EXAM_PROJECT_DATA_H
 
+#include "delay.h"
+
 namespace StochasticSimulation {
     class SimulationState;
     struct Reaction;
@@ -96,6 +98,7 @@ namespace StochasticSimulation {
         std::optional<std::vector<Reactant>> catalysts;
         double_t rate{};
         double_t delay{-1};
+        std::optional<ReactionDelay> latency{};  // products appear this long after the reaction happens
 
         Reaction(std::set<Reactant> from, std::set<Reactant> to):
                 from(from),
@@ -0,0 +1,104 @@
+#ifndef SP_EXAM_PROJECT_DELAY_H
+#define SP_EXAM_PROJECT_DELAY_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include <functional>
+
+namespace StochasticSimulation {
+
+    // Time between a delayed reaction starting and its products appearing. The reactants
+    // are consumed when the reaction starts, catalysts are only required at that moment.
+    struct ReactionDelay {
+        enum class Distribution {
+            fixed,    // always first
+            uniform,  // uniform between first and second
+            gamma     // gamma with shape first and scale second
+        };
+
+        Distribution distribution;
+        double_t first;
+        double_t second{0};
+
+        static ReactionDelay fixed(double_t delay) {
+            return {Distribution::fixed, delay};
+        }
+
+        static ReactionDelay uniform(double_t min, double_t max) {
+            return {Distribution::uniform, min, max};
+        }
+
+        static ReactionDelay gamma(double_t shape, double_t scale) {
+            return {Distribution::gamma, shape, scale};
+        }
+
+        template<typename Engine>
+        double_t sample(Engine& engine) const {
+            switch (distribution) {
+                case Distribution::uniform:
+                    return std::uniform_real_distribution<double_t>(first, second)(engine);
+                case Distribution::gamma:
+                    return std::gamma_distribution<double_t>(first, second)(engine);
+                default:
+                    return first;
+            }
+        }
+    };
+
+    struct PendingCompletion {
+        double_t time;
+        size_t reaction;
+
+        bool operator>(const PendingCompletion& other) const {
+            return time > other.time;
+        }
+    };
+
+    // Binary min-heap of delayed reactions in flight, O(log n) to add or remove one
+    class CompletionQueue {
+    private:
+        std::vector<PendingCompletion> heap{};
+        size_t peak{0};
+    public:
+        void push(double_t time, size_t reaction) {
+            heap.push_back({time, reaction});
+            std::push_heap(heap.begin(), heap.end(), std::greater<>{});
+            peak = std::max(peak, heap.size());
+        }
+
+        PendingCompletion pop() {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<>{});
+            auto completion = heap.back();
+            heap.pop_back();
+            return completion;
+        }
+
+        // Infinity when nothing is in flight
+        [[nodiscard]] double_t next_time() const {
+            return heap.empty() ? std::numeric_limits<double_t>::infinity() : heap.front().time;
+        }
+
+        [[nodiscard]] size_t size() const {
+            return heap.size();
+        }
+
+        [[nodiscard]] bool empty() const {
+            return heap.empty();
+        }
+
+        void reserve(size_t in_flight) {
+            heap.reserve(in_flight);
+        }
+
+        // Most reactions that were in flight at once
+        [[nodiscard]] size_t peak_size() const {
+            return peak;
+        }
+    };
+}
+
+#endif //SP_EXAM_PROJECT_DELAY_H
@@ -0,0 +1,139 @@
+#include "simulation.h"
+
+namespace StochasticSimulation {
+
+    namespace {
+        // Interior rows 1..rows-2 split into buckets of nearly equal size
+        size_t bucket_start(size_t bucket, size_t buckets, size_t rows) {
+            return 1 + bucket * (rows - 2) / buckets;
+        }
+
+        // Each bucket keeps, per species, the row forming the largest triangle with the row kept in the
+        // previous bucket and the average of the next bucket
+        void lttb_rows(const SimulationTrajectory& trajectory, size_t points, std::vector<size_t>& result) {
+            auto rows = trajectory.size();
+            auto width = trajectory.width();
+            auto buckets = points - 2;
+
+            std::vector<size_t> previous(width, 0);
+            std::vector<double_t> next_average(width);
+            std::vector<double_t> best_area(width);
+            std::vector<size_t> best_row(width);
+
+            for (size_t bucket = 0; bucket < buckets; ++bucket) {
+                auto first = bucket_start(bucket, buckets, rows);
+                auto last = bucket_start(bucket + 1, buckets, rows);
+
+                // The last bucket is followed by the last row alone
+                auto next_first = last;
+                auto next_last = bucket + 1 < buckets ? bucket_start(bucket + 2, buckets, rows) : rows;
+                double_t next_time{0};
+                std::fill(next_average.begin(), next_average.end(), 0.0);
+                for (auto row = next_first; row < next_last; ++row) {
+                    next_time += trajectory.time(row);
+                    auto amounts = trajectory.row(row);
+                    for (size_t i = 0; i < width; ++i) {
+                        next_average[i] += amounts[i];
+                    }
+                }
+                auto count = static_cast<double_t>(next_last - next_first);
+                next_time /= count;
+                for (auto& average: next_average) {
+                    average /= count;
+                }
+
+                std::fill(best_area.begin(), best_area.end(), -1.0);
+                for (auto row = first; row < last; ++row) {
+                    auto time = trajectory.time(row);
+                    auto amounts = trajectory.row(row);
+                    for (size_t i = 0; i < width; ++i) {
+                        auto previous_time = trajectory.time(previous[i]);
+                        auto previous_amount = trajectory.row(previous[i])[i];
+                        auto area = std::abs((previous_time - next_time) * (amounts[i] - previous_amount) -
+                                             (previous_time - time) * (next_average[i] - previous_amount));
+                        if (area > best_area[i]) {
+                            best_area[i] = area;
+                            best_row[i] = row;
+                        }
+                    }
+                }
+
+                for (size_t i = 0; i < width; ++i) {
+                    previous[i] = best_row[i];
+                    result.push_back(best_row[i]);
+                }
+            }
+        }
+
+        void min_max_rows(const SimulationTrajectory& trajectory, size_t points, std::vector<size_t>& result) {
+            auto rows = trajectory.size();
+            auto width = trajectory.width();
+            auto buckets = std::max<size_t>(1, (points - 2) / 2);
+
+            std::vector<size_t> lowest(width);
+            std::vector<size_t> highest(width);
+
+            for (size_t bucket = 0; bucket < buckets; ++bucket) {
+                auto first = bucket_start(bucket, buckets, rows);
+                auto last = bucket_start(bucket + 1, buckets, rows);
+                if (first == last) {
+                    continue;
+                }
+
+                std::fill(lowest.begin(), lowest.end(), first);
+                std::fill(highest.begin(), highest.end(), first);
+                for (auto row = first + 1; row < last; ++row) {
+                    auto amounts = trajectory.row(row);
+                    for (size_t i = 0; i < width; ++i) {
+                        if (amounts[i] < trajectory.row(lowest[i])[i]) {
+                            lowest[i] = row;
+                        }
+                        if (amounts[i] > trajectory.row(highest[i])[i]) {
+                            highest[i] = row;
+                        }
+                    }
+                }
+
+                result.insert(result.end(), lowest.begin(), lowest.end());
+                result.insert(result.end(), highest.begin(), highest.end());
+            }
+        }
+    }
+
+    std::vector<size_t> SimulationTrajectory::downsampled_rows(const DownsamplingOptions& downsampling) const {
+        std::vector<size_t> result{};
+        if (downsampling.method == Downsampling::none || size() <= std::max<size_t>(downsampling.points, 2)) {
+            result.resize(size());
+            std::iota(result.begin(), result.end(), 0);
+            return result;
+        }
+
+        result.push_back(0);
+        if (downsampling.points > 2) {
+            if (downsampling.method == Downsampling::lttb) {
+                lttb_rows(*this, downsampling.points, result);
+            } else {
+                min_max_rows(*this, downsampling.points, result);
+            }
+        }
+        result.push_back(size() - 1);
+
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+
+    SimulationTrajectory SimulationTrajectory::downsample(const DownsamplingOptions& downsampling) const {
+        auto rows = downsampled_rows(downsampling);
+        std::vector<double_t> kept_times{};
+        std::vector<double_t> kept_amounts{};
+        kept_times.reserve(rows.size());
+        kept_amounts.reserve(rows.size() * width());
+        for (auto row: rows) {
+            kept_times.push_back(times[row]);
+            auto amounts = this->row(row);
+            kept_amounts.insert(kept_amounts.end(), amounts.begin(), amounts.end());
+        }
+        return SimulationTrajectory{layout, std::move(kept_times), std::move(kept_amounts)};
+    }
+}
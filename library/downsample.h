@@ -0,0 +1,21 @@
+#ifndef SP_EXAM_PROJECT_DOWNSAMPLE_H
+#define SP_EXAM_PROJECT_DOWNSAMPLE_H
+
+#include <cstddef>
+
+namespace StochasticSimulation {
+
+    enum class Downsampling {
+        none,
+        lttb,     // largest triangle three buckets, keeps the visual shape of every species
+        min_max   // the lowest and highest row of every species in every bucket, keeps the envelope
+    };
+
+    // Rows picked per species and merged, so the result has at most about points rows per species
+    struct DownsamplingOptions {
+        Downsampling method{Downsampling::none};
+        size_t points{2000};
+    };
+}
+
+#endif //SP_EXAM_PROJECT_DOWNSAMPLE_H
@@ -0,0 +1,40 @@
+#ifndef SP_EXAM_PROJECT_ENSEMBLE_H
+#define SP_EXAM_PROJECT_ENSEMBLE_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <optional>
+#include <stop_token>
+#include "placement.h"
+
+namespace StochasticSimulation {
+
+    class TrajectoryWriter;
+
+    // Counters updated by the workers while an ensemble runs, safe to poll from any thread
+    struct EnsembleProgress {
+        std::atomic<size_t> runs_done{0};
+        std::atomic<size_t> events{0};
+        std::atomic<double_t> simulated_time{0};  // summed over all runs
+    };
+
+    struct EnsembleControl {
+        std::stop_token stop_token{};
+        std::optional<std::chrono::steady_clock::duration> time_budget{};
+        EnsembleProgress* progress{nullptr};
+        // Called from the worker thread whenever it finishes a run
+        std::function<void(const EnsembleProgress&)> on_run_finished{};
+        // Pinned workers copy the vessel and allocate their trajectories after pinning, so the memory they
+        // touch is on their own node
+        ThreadPlacement placement{ThreadPlacement::unpinned};
+        PlacementReport* placement_report{nullptr};
+        // Finished runs are also handed to the writer, numbered by the slot they were planned for: worker w
+        // writes runs w * (runs per worker) onwards. These are the positions in the result unless the
+        // ensemble is stopped, then numbers are missing. The writer is not closed by the ensemble.
+        TrajectoryWriter* writer{nullptr};
+    };
+}
+
+#endif //SP_EXAM_PROJECT_ENSEMBLE_H
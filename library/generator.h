@@ -0,0 +1,136 @@
+#ifndef SP_EXAM_PROJECT_GENERATOR_H
+#define SP_EXAM_PROJECT_GENERATOR_H
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <utility>
+
+namespace StochasticSimulation {
+
+    // Lazy sequence produced by a coroutine, the coroutine only runs when the consumer pulls the next value
+    template<typename T>
+    class Generator {
+    public:
+        struct promise_type {
+            std::optional<T> current{};
+            std::exception_ptr exception{};
+
+            Generator get_return_object() {
+                return Generator{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            std::suspend_always final_suspend() noexcept {
+                return {};
+            }
+
+            std::suspend_always yield_value(T value) noexcept {
+                current.emplace(std::move(value));
+                return {};
+            }
+
+            void return_void() noexcept {}
+
+            void unhandled_exception() {
+                exception = std::current_exception();
+            }
+        };
+
+        class iterator {
+        private:
+            std::coroutine_handle<promise_type> handle{};
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+
+            iterator() = default;
+            explicit iterator(std::coroutine_handle<promise_type> handle): handle(handle) {}
+
+            const T& operator*() const {
+                return handle.promise().current.value();
+            }
+
+            const T* operator->() const {
+                return &handle.promise().current.value();
+            }
+
+            iterator& operator++() {
+                resume(handle);
+                return *this;
+            }
+
+            void operator++(int) {
+                ++*this;
+            }
+
+            bool operator==(std::default_sentinel_t) const {
+                return !handle || handle.done();
+            }
+        };
+    private:
+        std::coroutine_handle<promise_type> handle{};
+
+        static void resume(std::coroutine_handle<promise_type> handle) {
+            handle.resume();
+            if (handle.promise().exception) {
+                std::rethrow_exception(handle.promise().exception);
+            }
+        }
+    public:
+        explicit Generator(std::coroutine_handle<promise_type> handle): handle(handle) {}
+
+        Generator(const Generator&) = delete;
+        Generator& operator=(const Generator&) = delete;
+
+        Generator(Generator&& rval) noexcept: handle(std::exchange(rval.handle, {})) {}
+
+        Generator& operator=(Generator&& rval) noexcept {
+            if (this != &rval) {
+                if (handle) {
+                    handle.destroy();
+                }
+                handle = std::exchange(rval.handle, {});
+            }
+            return *this;
+        }
+
+        ~Generator() {
+            if (handle) {
+                handle.destroy();
+            }
+        }
+
+        // Computes the next value, returns false once the sequence is exhausted
+        bool next() {
+            if (!handle || handle.done()) {
+                return false;
+            }
+            resume(handle);
+            return !handle.done();
+        }
+
+        // Value produced by the last call to next()
+        const T& value() const {
+            return handle.promise().current.value();
+        }
+
+        iterator begin() {
+            if (handle && !handle.done()) {
+                resume(handle);
+            }
+            return iterator{handle};
+        }
+
+        std::default_sentinel_t end() {
+            return {};
+        }
+    };
+}
+
+#endif //SP_EXAM_PROJECT_GENERATOR_H
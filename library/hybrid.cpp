@@ -0,0 +1,172 @@
+#include <stdexcept>
+#include "network.h"
+
+namespace StochasticSimulation {
+
+    namespace {
+        class HybridPartition {
+        public:
+            std::vector<size_t> fast{};
+            std::vector<size_t> slow{};
+
+            explicit HybridPartition(size_t reactions) {
+                fast.reserve(reactions);
+                slow.reserve(reactions);
+            }
+
+            void update(const ReactionNetwork& network, std::span<const double_t> amounts, const HybridOptions& options) {
+                fast.clear();
+                slow.clear();
+
+                for (size_t r = 0; r < network.reactions.size(); ++r) {
+                    auto& reaction = network.reactions[r];
+                    auto populous = [&](const SpeciesAmount& e){ return amounts[e.species] >= options.population_threshold; };
+
+                    auto continuous = network.propensity(r, amounts) >= options.propensity_threshold &&
+                            std::all_of(reaction.inputs.begin(), reaction.inputs.end(), populous) &&
+                            std::all_of(reaction.catalysts.begin(), reaction.catalysts.end(), populous) &&
+                            std::all_of(reaction.changes.begin(), reaction.changes.end(), populous);
+
+                    (continuous ? fast : slow).push_back(r);
+                }
+            }
+        };
+
+        void fast_derivatives(const ReactionNetwork& network, const std::vector<size_t>& fast, std::span<const double_t> amounts, std::span<double_t> result) {
+            std::fill(result.begin(), result.end(), 0.0);
+            for (auto r: fast) {
+                auto a = network.propensity(r, amounts);
+                for (auto& change: network.reactions[r].changes) {
+                    result[change.species] += change.amount * a;
+                }
+            }
+        }
+    }
+
+    // Fast reactions are integrated as continuous processes while the slow reactions fire exactly,
+    // a slow reaction fires when the integrated slow propensity reaches an exponential threshold
+    std::shared_ptr<SimulationTrajectory> Vessel::do_hybrid_simulation(double_t end_time, const HybridOptions& options, simulation_monitor& monitor) {
+        ReactionNetwork network{*this};
+        if (network.has_delays()) {
+            throw std::invalid_argument("Delayed reactions are not supported by the hybrid simulation");
+        }
+        SimulationTrajectory trajectory{reactants};
+        trajectory.reserve(reserved_rows());
+        SimulationState state{reactants, 0};
+        auto engine = make_random_engine();
+        std::exponential_distribution<double_t> exponential{1.0};
+        std::normal_distribution<double_t> normal{0.0, 1.0};
+        std::uniform_real_distribution<double_t> uniform{0.0, 1.0};
+
+        auto x = network.initial_amounts();
+        auto n = x.size();
+        std::vector<double_t> k1(n), k2(n), midpoint(n), slow_propensities{};
+        slow_propensities.reserve(network.reactions.size());
+        trajectory.insert(0, x);
+
+        HybridPartition partition{network.reactions.size()};
+        partition.update(network, x, options);
+        double_t next_partition{options.repartition_interval};
+
+        double_t t{0};
+        double_t slow_integral{0};
+        double_t slow_threshold{exponential(engine)};
+
+        auto& interventions = network.interventions;
+        size_t next_intervention{0};
+
+        while (t < end_time) {
+            if (next_intervention < interventions.size() && interventions[next_intervention].time <= t) {
+                while (next_intervention < interventions.size() && interventions[next_intervention].time <= t) {
+                    network.apply(interventions[next_intervention++], x);
+                }
+                partition.update(network, x, options);
+                trajectory.insert(t, x);
+            }
+            auto stop = next_intervention < interventions.size() ? std::min(end_time, interventions[next_intervention].time) : end_time;
+
+            double_t slow_total{0};
+            for (auto r: partition.slow) {
+                slow_total += network.propensity(r, x);
+            }
+
+            // Shorten the step if the next slow reaction happens within it
+            auto h = std::min({options.step, stop - t, std::max(next_partition - t, 0.0)});
+            auto fire_slow = false;
+            if (slow_total > 0 && slow_integral + slow_total * h >= slow_threshold) {
+                h = (slow_threshold - slow_integral) / slow_total;
+                fire_slow = true;
+            }
+
+            if (!partition.fast.empty() && h > 0) {
+                if (options.langevin) {
+                    // Euler-Maruyama step of the chemical Langevin equation
+                    for (auto r: partition.fast) {
+                        auto a = network.propensity(r, x);
+                        auto events = a * h + std::sqrt(a * h) * normal(engine);
+                        for (auto& change: network.reactions[r].changes) {
+                            k1[change.species] += change.amount * events;
+                        }
+                    }
+                    for (size_t i = 0; i < n; ++i) {
+                        x[i] += k1[i];
+                        k1[i] = 0;
+                    }
+                } else {
+                    // Midpoint step of the reaction rate equations
+                    fast_derivatives(network, partition.fast, x, k1);
+                    for (size_t i = 0; i < n; ++i) {
+                        midpoint[i] = x[i] + 0.5 * h * k1[i];
+                    }
+                    fast_derivatives(network, partition.fast, midpoint, k2);
+                    for (size_t i = 0; i < n; ++i) {
+                        x[i] += h * k2[i];
+                    }
+                }
+                for (auto& amount: x) {
+                    amount = std::max(amount, 0.0);
+                }
+            }
+
+            t += h;
+            slow_integral += slow_total * h;
+
+            if (fire_slow) {
+                slow_propensities.clear();
+                double_t total{0};
+                for (auto r: partition.slow) {
+                    total += network.propensity(r, x);
+                    slow_propensities.push_back(total);
+                }
+
+                if (total > 0) {
+                    auto target = uniform(engine) * total;
+                    auto selected = std::upper_bound(slow_propensities.begin(), slow_propensities.end(), target) - slow_propensities.begin();
+                    auto r = partition.slow[std::min<size_t>(selected, partition.slow.size() - 1)];
+                    if (network.can_fire(r, x)) {
+                        network.fire(r, x);
+                    }
+                }
+
+                slow_integral = 0;
+                slow_threshold = exponential(engine);
+            }
+
+            if (t >= next_partition) {
+                partition.update(network, x, options);
+                next_partition = t + options.repartition_interval;
+            }
+
+            trajectory.insert(t, x);
+
+            state.time = t;
+            for (size_t i = 0; i < n; ++i) {
+                state.reactants[Symbol{i}].amount = x[i];
+            }
+            monitor.monitor(state);
+        }
+
+        record_run(trajectory.size());
+        return std::make_shared<SimulationTrajectory>(std::move(trajectory));
+    }
+}
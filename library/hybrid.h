@@ -0,0 +1,20 @@
+#ifndef SP_EXAM_PROJECT_HYBRID_H
+#define SP_EXAM_PROJECT_HYBRID_H
+
+#include <cmath>
+
+namespace StochasticSimulation {
+
+    // A reaction is treated as continuous when it fires at least propensity_threshold times per
+    // time unit and every species it reads or changes has at least population_threshold of it,
+    // all other reactions are simulated exactly
+    struct HybridOptions {
+        double_t population_threshold{1000};
+        double_t propensity_threshold{100};
+        double_t step{0.01};                 // fixed step of the continuous part
+        double_t repartition_interval{1.0};  // time between re-evaluating the partition
+        bool langevin{false};                // chemical Langevin equation instead of reaction rate equations
+    };
+}
+
+#endif //SP_EXAM_PROJECT_HYBRID_H
@@ -0,0 +1,26 @@
+#ifndef SP_EXAM_PROJECT_INTERVENTION_H
+#define SP_EXAM_PROJECT_INTERVENTION_H
+
+#include <cmath>
+#include <cstddef>
+
+namespace StochasticSimulation {
+
+    // Change to a running simulation at a given time. Reactions are numbered in the order they were
+    // added to the vessel and reactants by their symbol id.
+    struct Intervention {
+        enum class Kind {
+            rate,    // set the rate of reaction target to value
+            amount,  // add value (may be negative) to the amount of reactant target
+            enable,  // let reaction target happen again
+            disable  // stop reaction target from happening
+        };
+
+        double_t time;
+        Kind kind;
+        size_t target;
+        double_t value{0};
+    };
+}
+
+#endif //SP_EXAM_PROJECT_INTERVENTION_H
@@ -0,0 +1,124 @@
+#include <barrier>
+#include "metapopulation.h"
+#include "stepper.h"
+
+namespace StochasticSimulation {
+
+    size_t Metapopulation::add_compartment(std::string name, Vessel vessel) {
+        names.push_back(std::move(name));
+        compartments.push_back(std::move(vessel));
+        return compartments.size() - 1;
+    }
+
+    void Metapopulation::connect(size_t from, size_t to, const std::string& species, double_t rate) {
+        if (from >= compartments.size() || to >= compartments.size()) {
+            throw std::out_of_range("Unknown compartment in connection");
+        }
+        if (!compartments[from].get_reactants().contains(species) || !compartments[to].get_reactants().contains(species)) {
+            throw SymbolTableException("Key " + species + " must exist in both connected compartments");
+        }
+        connections.push_back({from, to, species, rate});
+    }
+
+    std::vector<std::shared_ptr<SimulationTrajectory>> Metapopulation::do_simulation(double_t end_time, const MetapopulationOptions& options) {
+        auto count = compartments.size();
+        if (count == 0) {
+            return {};
+        }
+
+        std::vector<DirectMethodStepper> steppers{};
+        std::vector<SimulationTrajectory> trajectories{};
+        steppers.reserve(count);
+        trajectories.reserve(count);
+
+        auto seed_engine = make_random_engine();
+        for (size_t c = 0; c < count; ++c) {
+            // Mixed through a seed sequence, consecutive outputs of the engine as seeds give shifted copies of one stream
+            std::seed_seq sequence{seed_engine(), seed_engine()};
+            steppers.emplace_back(ReactionNetwork{compartments[c]}, std::default_random_engine{sequence});
+            trajectories.emplace_back(compartments[c].get_reactants());
+            trajectories[c].insert(0, steppers[c].amounts);
+        }
+
+        struct ResolvedConnection {
+            size_t from;
+            size_t to;
+            size_t from_species;
+            size_t to_species;
+            double_t rate;
+        };
+        std::vector<ResolvedConnection> resolved{};
+        for (auto& connection: connections) {
+            resolved.push_back({
+                connection.from,
+                connection.to,
+                compartments[connection.from].get_reactants().symbol(connection.species).id,
+                compartments[connection.to].get_reactants().symbol(connection.species).id,
+                connection.rate
+            });
+        }
+
+        auto threads = options.threads == 0 ? std::max<size_t>(1, std::thread::hardware_concurrency()) : options.threads;
+        threads = std::min(threads, count);
+        auto windows = static_cast<size_t>(std::ceil(end_time / options.window));
+
+        size_t window{0};
+        auto window_end = [&options, end_time](size_t w) {
+            return std::min(static_cast<double_t>(w + 1) * options.window, end_time);
+        };
+
+        // Runs on one thread once all threads have finished the window
+        auto exchange = [&]() noexcept {
+            auto t = window_end(window);
+            for (auto& connection: resolved) {
+                auto& source = steppers[connection.from];
+                auto& destination = steppers[connection.to];
+                auto available = source.amounts[connection.from_species];
+                auto mean = connection.rate * available * (t - static_cast<double_t>(window) * options.window);
+                if (mean <= 0) {
+                    continue;
+                }
+
+                auto moved = std::min(static_cast<double_t>(std::poisson_distribution<uint64_t>(mean)(seed_engine)), available);
+                source.amounts[connection.from_species] -= moved;
+                destination.amounts[connection.to_species] += moved;
+                source.changed(connection.from_species);
+                destination.changed(connection.to_species);
+            }
+            window++;
+        };
+
+        std::barrier sync(static_cast<std::ptrdiff_t>(threads), exchange);
+
+        auto worker = [&](size_t first, size_t last) {
+            for (size_t w = 0; w < windows; ++w) {
+                auto until = window_end(w);
+                for (size_t c = first; c < last; ++c) {
+                    auto& stepper = steppers[c];
+                    while (stepper.step(until)) {
+                        trajectories[c].insert(stepper.time, stepper.amounts);
+                    }
+                }
+                sync.arrive_and_wait();
+
+                // Transfers show up as a row at the window boundary
+                for (size_t c = first; c < last; ++c) {
+                    trajectories[c].insert(steppers[c].time, steppers[c].amounts);
+                }
+            }
+        };
+
+        {
+            std::vector<std::jthread> pool{};
+            for (size_t i = 0; i < threads; ++i) {
+                pool.emplace_back(worker, i * count / threads, (i + 1) * count / threads);
+            }
+        }
+
+        std::vector<std::shared_ptr<SimulationTrajectory>> result{};
+        for (auto& trajectory: trajectories) {
+            result.push_back(std::make_shared<SimulationTrajectory>(std::move(trajectory)));
+        }
+        return result;
+    }
+}
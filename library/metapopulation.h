@@ -0,0 +1,52 @@
+#ifndef SP_EXAM_PROJECT_METAPOPULATION_H
+#define SP_EXAM_PROJECT_METAPOPULATION_H
+
+#include "simulation.h"
+
+namespace StochasticSimulation {
+
+    struct MetapopulationOptions {
+        double_t window{0.1};  // length of the synchronised time windows
+        size_t threads{0};     // 0 uses one thread per core, never more than there are compartments
+    };
+
+    // Vessels (compartments) coupled by transfer of a species from one to another.
+    //
+    // Time is cut into windows. Within a window every compartment is simulated exactly and
+    // independently, the compartments are split into contiguous blocks with one thread per block.
+    // At the end of a window all threads meet at a barrier where the transfers of the window are
+    // applied as a tau-leap: a Poisson number of individuals with mean rate * amount * window moves
+    // along every connection. The work per window scales with the events in the compartments while
+    // the synchronisation is a single barrier, so dozens of compartments spread over the cores.
+    class Metapopulation {
+    private:
+        struct Connection {
+            size_t from;
+            size_t to;
+            std::string species;
+            double_t rate;
+        };
+
+        std::vector<std::string> names{};
+        std::vector<Vessel> compartments{};
+        std::vector<Connection> connections{};
+    public:
+        size_t add_compartment(std::string name, Vessel vessel);
+
+        // Each individual of the species in from moves to to with the given rate
+        void connect(size_t from, size_t to, const std::string& species, double_t rate);
+
+        [[nodiscard]] const std::string& name(size_t compartment) const {
+            return names.at(compartment);
+        }
+
+        [[nodiscard]] size_t size() const {
+            return compartments.size();
+        }
+
+        // One trajectory per compartment, in the order they were added
+        std::vector<std::shared_ptr<SimulationTrajectory>> do_simulation(double_t end_time, const MetapopulationOptions& options = {});
+    };
+}
+
+#endif //SP_EXAM_PROJECT_METAPOPULATION_H
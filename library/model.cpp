@@ -0,0 +1,321 @@
+#include <charconv>
+#include <fstream>
+#include "model.h"
+
+namespace StochasticSimulation {
+
+    namespace {
+        constexpr std::string_view environment_name = "env";
+
+        struct Term {
+            std::string_view name;  // environment_name for the environment
+            size_t required;
+            size_t start;           // position of the term, for errors found after parsing it
+        };
+
+        class ModelParser {
+        private:
+            std::string_view text;
+            std::string_view source;
+            size_t position{0};
+            size_t line{1};
+            size_t line_start{0};
+            Vessel vessel{};
+
+            // Reused for every reaction
+            std::vector<Term> inputs{};
+            std::vector<Term> outputs{};
+            std::vector<Term> catalysts{};
+
+            [[noreturn]] void fail(std::string_view problem, size_t at) const {
+                throw ModelException(source, line, at - line_start + 1, problem);
+            }
+
+            [[noreturn]] void fail(std::string_view problem) const {
+                fail(problem, position);
+            }
+
+            [[nodiscard]] bool at_end() const {
+                return position >= text.size();
+            }
+
+            [[nodiscard]] char peek() const {
+                return at_end() ? '\0' : text[position];
+            }
+
+            void skip_spaces() {
+                while (!at_end() && (text[position] == ' ' || text[position] == '\t' || text[position] == '\r')) {
+                    position++;
+                }
+            }
+
+            bool accept(std::string_view token) {
+                skip_spaces();
+                if (text.substr(position, token.size()) == token) {
+                    position += token.size();
+                    return true;
+                }
+                return false;
+            }
+
+            // A word that is not the start of a longer identifier, 'delay' does not match 'delayed'
+            bool accept_keyword(std::string_view keyword) {
+                skip_spaces();
+                auto end = position + keyword.size();
+                if (text.substr(position, keyword.size()) != keyword || (end < text.size() && is_identifier_char(text[end]))) {
+                    return false;
+                }
+                position += keyword.size();
+                return true;
+            }
+
+            void expect(std::string_view token, std::string_view problem) {
+                if (!accept(token)) {
+                    fail(problem);
+                }
+            }
+
+            static bool is_identifier_start(char c) {
+                return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+            }
+
+            static bool is_identifier_char(char c) {
+                return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+            }
+
+            std::string_view identifier() {
+                skip_spaces();
+                auto start = position;
+                if (!is_identifier_start(peek())) {
+                    fail("expected a species name");
+                }
+                while (is_identifier_char(peek())) {
+                    position++;
+                }
+                return text.substr(start, position - start);
+            }
+
+            size_t integer(std::string_view problem) {
+                skip_spaces();
+                size_t value{0};
+                auto [end, error] = std::from_chars(text.data() + position, text.data() + text.size(), value);
+                if (error != std::errc{} || (end < text.data() + text.size() && *end == '.')) {
+                    fail(problem);
+                }
+                position = end - text.data();
+                return value;
+            }
+
+            double_t number(std::string_view problem) {
+                skip_spaces();
+                double_t value{0};
+                auto start = position;
+                auto [end, error] = std::from_chars(text.data() + position, text.data() + text.size(), value);
+                if (error != std::errc{} || !std::isfinite(value) || value < 0) {
+                    fail(problem, start);
+                }
+                position = end - text.data();
+                return value;
+            }
+
+            // Optional amount required followed by a species, 2B and 2 B are both accepted
+            Term term() {
+                skip_spaces();
+                auto term_start = position;
+                size_t required{1};
+                if (std::isdigit(static_cast<unsigned char>(peek()))) {
+                    required = integer("expected the amount required of a species");
+                    if (required == 0) {
+                        fail("the amount required must be positive");
+                    }
+                }
+                auto start = position;
+                auto name = identifier();
+                if (name != environment_name && !vessel.get_reactants().contains(name)) {
+                    fail("unknown species '" + std::string(name) + "', species are declared as " + std::string(name) + " = <amount>", start);
+                }
+                return {name, required, term_start};
+            }
+
+            void side(std::vector<Term>& terms) {
+                terms.clear();
+                terms.push_back(term());
+                while (accept("+")) {
+                    terms.push_back(term());
+                }
+            }
+
+            // A species appearing twice on one side is required twice
+            static void merge(std::vector<Term>& terms) {
+                for (size_t i = 0; i < terms.size(); ++i) {
+                    for (auto j = i + 1; j < terms.size();) {
+                        if (terms[j].name == terms[i].name) {
+                            terms[i].required += terms[j].required;
+                            terms.erase(terms.begin() + static_cast<std::ptrdiff_t>(j));
+                        } else {
+                            ++j;
+                        }
+                    }
+                }
+            }
+
+            std::set<Reactant> reactants(std::vector<Term>& terms) {
+                merge(terms);
+                std::set<Reactant> result{};
+                for (auto& term: terms) {
+                    if (term.name == environment_name) {
+                        result.insert(vessel.environment());
+                    } else {
+                        result.emplace(std::string(term.name), size_t{0}, term.required);
+                    }
+                }
+                return result;
+            }
+
+            ReactionDelay delay() {
+                skip_spaces();
+                auto start = position;
+                auto kind = identifier();
+                expect("(", "expected '(' after the delay distribution");
+                auto first = number("expected a non-negative number");
+                if (kind == "fixed") {
+                    expect(")", "expected ')', a fixed delay has one parameter");
+                    return ReactionDelay::fixed(first);
+                }
+                expect(",", "expected ',' and a second parameter");
+                auto second = number("expected a non-negative number");
+                expect(")", "expected ')'");
+                if (kind == "uniform") {
+                    if (second < first) {
+                        fail("the maximum of a uniform delay is below its minimum", start);
+                    }
+                    return ReactionDelay::uniform(first, second);
+                }
+                if (kind == "gamma") {
+                    if (first <= 0 || second <= 0) {
+                        fail("the shape and scale of a gamma delay must be positive", start);
+                    }
+                    return ReactionDelay::gamma(first, second);
+                }
+                fail("unknown delay distribution '" + std::string(kind) + "', expected fixed, uniform or gamma", start);
+            }
+
+            void declaration(std::string_view name, size_t start) {
+                if (name == environment_name) {
+                    fail("env is the environment and cannot be declared", start);
+                }
+                if (vessel.get_reactants().contains(name)) {
+                    fail("species '" + std::string(name) + "' is already declared", start);
+                }
+                auto amount = integer("expected the initial amount, a non-negative integer");
+                vessel(std::string(name), amount);
+            }
+
+            void reaction() {
+                side(inputs);
+                expect("->", "expected '->' or '+'");
+                side(outputs);
+
+                catalysts.clear();
+                if (accept("[")) {
+                    catalysts.push_back(term());
+                    while (accept(",")) {
+                        catalysts.push_back(term());
+                    }
+                    expect("]", "expected ']' or ','");
+                }
+
+                expect("@", "expected '@' and the rate");
+                auto rate = number("expected the rate, a non-negative number");
+
+                std::optional<ReactionDelay> latency{};
+                if (accept_keyword("delay")) {
+                    latency = delay();
+                }
+
+                Reaction reaction{reactants(inputs), reactants(outputs), rate};
+                if (!catalysts.empty()) {
+                    merge(catalysts);
+                    reaction.catalysts = std::vector<Reactant>{};
+                    for (auto& catalyst: catalysts) {
+                        if (catalyst.name == environment_name) {
+                            fail("the environment cannot be a catalyst", catalyst.start);
+                        }
+                        reaction.catalysts->emplace_back(std::string(catalyst.name), size_t{0}, catalyst.required);
+                    }
+                }
+                reaction.latency = latency;
+                vessel.add_reaction(std::move(reaction));
+            }
+
+            void end_of_statement() {
+                skip_spaces();
+                if (peek() == '#') {
+                    while (!at_end() && text[position] != '\n') {
+                        position++;
+                    }
+                }
+                if (!at_end() && text[position] != '\n') {
+                    fail("unexpected '" + std::string(1, text[position]) + "'");
+                }
+            }
+
+            void statement() {
+                skip_spaces();
+                if (at_end() || peek() == '\n' || peek() == '#') {
+                    end_of_statement();
+                    return;
+                }
+
+                // A declaration starts with a name followed by '=', anything else is a reaction
+                auto start = position;
+                if (is_identifier_start(peek())) {
+                    auto name = identifier();
+                    if (accept("=")) {
+                        declaration(name, start);
+                        end_of_statement();
+                        return;
+                    }
+                    position = start;
+                }
+                reaction();
+                end_of_statement();
+            }
+        public:
+            ModelParser(std::string_view text, std::string_view source): text(text), source(source) {}
+
+            Vessel parse() {
+                size_t arrows{0};
+                for (auto at = text.find("->"); at != std::string_view::npos; at = text.find("->", at + 2)) {
+                    arrows++;
+                }
+                vessel.reserve_reactions(arrows);
+
+                while (!at_end()) {
+                    statement();
+                    if (!at_end()) {
+                        position++;
+                        line++;
+                        line_start = position;
+                    }
+                }
+                return std::move(vessel);
+            }
+        };
+    }
+
+    Vessel parse_model(std::string_view text, std::string_view source) {
+        return ModelParser{text, source}.parse();
+    }
+
+    Vessel load_model(const std::string& path) {
+        std::ifstream file{path, std::ios::binary | std::ios::ate};
+        if (!file) {
+            throw std::runtime_error("Could not open model " + path);
+        }
+        std::string text(static_cast<size_t>(file.tellg()), '\0');
+        file.seekg(0);
+        file.read(text.data(), static_cast<std::streamsize>(text.size()));
+        return parse_model(text, path);
+    }
+}
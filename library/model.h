@@ -0,0 +1,43 @@
+#ifndef SP_EXAM_PROJECT_MODEL_H
+#define SP_EXAM_PROJECT_MODEL_H
+
+#include "simulation.h"
+
+namespace StochasticSimulation {
+
+    // Error in a model file, the position is 1-based
+    struct ModelException : public std::exception
+    {
+        std::string message;
+        size_t line;
+        size_t column;
+    public:
+        ModelException(std::string_view source, size_t line, size_t column, std::string_view problem):
+            message(std::string(source) + ":" + std::to_string(line) + ":" + std::to_string(column) + ": " + std::string(problem)),
+            line(line),
+            column(column)
+        {}
+
+        [[nodiscard]] const char* what() const noexcept override
+        {
+            return message.c_str();
+        }
+    };
+
+    // Reaction networks as text, one statement per line and # starting a comment:
+    //
+    //     S = 9991                         species with its initial amount
+    //     S + I -> E + I @ 0.0000774       reaction with its rate
+    //     S -> E [I] @ 0.0000774           catalysts in brackets, separated by commas
+    //     A + 2B -> C [D, 2E] @ 1.5        amounts required before a species
+    //     I -> R @ 0.32 delay gamma(2, 3)  delayed products: fixed(d), uniform(min, max) or gamma(shape, scale)
+    //     A -> env @ 0.1                   env is the environment
+    //
+    // Species are declared before they are used. The text is read in one pass, the first error is thrown
+    // as a ModelException naming the line and column.
+    Vessel parse_model(std::string_view text, std::string_view source = "<model>");
+
+    Vessel load_model(const std::string& path);
+}
+
+#endif //SP_EXAM_PROJECT_MODEL_H
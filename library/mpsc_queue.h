@@ -0,0 +1,86 @@
+#ifndef SP_EXAM_PROJECT_MPSC_QUEUE_H
+#define SP_EXAM_PROJECT_MPSC_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace StochasticSimulation {
+
+    // Bounded lock-free queue for many producers and a single consumer (Vyukov's ring buffer). Every cell
+    // carries a sequence number telling whether it is free for the producer claiming that position or
+    // holds a value for the consumer, so neither side waits on a lock.
+    template<typename T>
+    class MpscQueue {
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        std::unique_ptr<Cell[]> cells;
+        size_t mask;
+        alignas(64) std::atomic<size_t> enqueue_position{0};
+        alignas(64) size_t dequeue_position{0};  // only touched by the consumer
+    public:
+        // The capacity is rounded up to a power of two
+        explicit MpscQueue(size_t capacity):
+            cells(std::make_unique<Cell[]>(std::bit_ceil(std::max<size_t>(capacity, 2)))),
+            mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1)
+        {
+            for (size_t i = 0; i <= mask; ++i) {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+
+        // Moves the value in unless the queue is full, the value is left untouched then
+        bool try_push(T& value) {
+            auto position = enqueue_position.load(std::memory_order_relaxed);
+            while (true) {
+                auto& cell = cells[position & mask];
+                auto sequence = cell.sequence.load(std::memory_order_acquire);
+                auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+                if (difference == 0) {
+                    if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        cell.value = std::move(value);
+                        cell.sequence.store(position + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (difference < 0) {
+                    return false;
+                } else {
+                    position = enqueue_position.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Consumer only
+        std::optional<T> try_pop() {
+            auto& cell = cells[dequeue_position & mask];
+            if (cell.sequence.load(std::memory_order_acquire) != dequeue_position + 1) {
+                return std::nullopt;
+            }
+
+            std::optional<T> result{std::move(cell.value)};
+            cell.value = T{};
+            cell.sequence.store(dequeue_position + mask + 1, std::memory_order_release);
+            dequeue_position++;
+            return result;
+        }
+
+        [[nodiscard]] size_t capacity() const {
+            return mask + 1;
+        }
+    };
+}
+
+#endif //SP_EXAM_PROJECT_MPSC_QUEUE_H
@@ -0,0 +1,174 @@
+#include "network.h"
+
+namespace StochasticSimulation {
+
+    static void add_change(std::vector<SpeciesAmount>& changes, size_t species, double_t amount) {
+        for (auto& change: changes) {
+            if (change.species == species) {
+                change.amount += amount;
+                return;
+            }
+        }
+        changes.push_back({species, amount});
+    }
+
+    ReactionNetwork::ReactionNetwork(const Vessel& vessel):
+        species(vessel.get_reactants()),
+        interventions(vessel.get_interventions())
+    {
+        reactions.reserve(vessel.get_reactions().size());
+
+        for (auto& reaction: vessel.get_reactions()) {
+            CompiledReaction compiled{{}, {}, {}, reaction.rate};
+
+            for (auto& reactant: reaction.from) {
+                if (reactant.name != "__env__") {
+                    auto id = species.symbol(reactant.name).id;
+                    compiled.inputs.push_back({id, static_cast<double_t>(reactant.required)});
+                    add_change(compiled.changes, id, -static_cast<double_t>(reactant.required));
+                }
+            }
+            for (auto& product: reaction.to) {
+                if (product.name != "__env__") {
+                    auto id = species.symbol(product.name).id;
+                    add_change(compiled.changes, id, static_cast<double_t>(product.required));
+                    compiled.products.push_back({id, static_cast<double_t>(product.required)});
+                }
+            }
+            if (reaction.catalysts.has_value()) {
+                for (auto& catalyst: reaction.catalysts.value()) {
+                    compiled.catalysts.push_back({species.symbol(catalyst.name).id, static_cast<double_t>(catalyst.required)});
+                }
+            }
+
+            compiled.delay = reaction.latency;
+            std::erase_if(compiled.changes, [](const SpeciesAmount& change){ return change.amount == 0; });
+            reactions.push_back(std::move(compiled));
+        }
+    }
+
+    size_t ReactionNetwork::apply(const Intervention& intervention, std::span<double_t> amounts) {
+        switch (intervention.kind) {
+            case Intervention::Kind::rate:
+                reactions[intervention.target].rate = intervention.value;
+                break;
+            case Intervention::Kind::amount:
+                amounts[intervention.target] = std::max(0.0, amounts[intervention.target] + intervention.value);
+                break;
+            case Intervention::Kind::enable:
+                reactions[intervention.target].enabled = true;
+                break;
+            case Intervention::Kind::disable:
+                reactions[intervention.target].enabled = false;
+                break;
+        }
+        return intervention.target;
+    }
+
+    std::vector<double_t> ReactionNetwork::initial_amounts() const {
+        std::vector<double_t> amounts{};
+        amounts.reserve(species.size());
+        for (auto& reactant: species) {
+            amounts.push_back(reactant.second.amount);
+        }
+        return amounts;
+    }
+
+    double_t ReactionNetwork::propensity(size_t reaction, std::span<const double_t> amounts) const {
+        auto& compiled = reactions[reaction];
+        if (!compiled.enabled) {
+            return 0;
+        }
+        auto result = compiled.rate;
+
+        for (auto& input: compiled.inputs) {
+            result *= amounts[input.species];
+        }
+        for (auto& catalyst: compiled.catalysts) {
+            result *= amounts[catalyst.species];
+        }
+
+        return result;
+    }
+
+    bool ReactionNetwork::can_fire(size_t reaction, std::span<const double_t> amounts) const {
+        auto& compiled = reactions[reaction];
+
+        return std::all_of(compiled.inputs.begin(), compiled.inputs.end(), [&amounts](const SpeciesAmount& e){ return amounts[e.species] >= e.amount; }) &&
+            std::all_of(compiled.catalysts.begin(), compiled.catalysts.end(), [&amounts](const SpeciesAmount& e){ return amounts[e.species] >= e.amount; });
+    }
+
+    void ReactionNetwork::fire(size_t reaction, std::span<double_t> amounts) const {
+        for (auto& change: reactions[reaction].changes) {
+            amounts[change.species] += change.amount;
+        }
+    }
+
+    void ReactionNetwork::start(size_t reaction, std::span<double_t> amounts) const {
+        for (auto& input: reactions[reaction].inputs) {
+            amounts[input.species] -= input.amount;
+        }
+    }
+
+    void ReactionNetwork::complete(size_t reaction, std::span<double_t> amounts) const {
+        for (auto& product: reactions[reaction].products) {
+            amounts[product.species] += product.amount;
+        }
+    }
+
+    bool ReactionNetwork::has_delays() const {
+        return std::any_of(reactions.begin(), reactions.end(), [](const CompiledReaction& reaction){ return reaction.delay.has_value(); });
+    }
+
+    void ReactionNetwork::derivatives(std::span<const double_t> amounts, std::span<double_t> result) const {
+        std::fill(result.begin(), result.end(), 0.0);
+
+        for (size_t r = 0; r < reactions.size(); ++r) {
+            auto a = propensity(r, amounts);
+            if (a == 0) {
+                continue;
+            }
+            for (auto& change: reactions[r].changes) {
+                result[change.species] += change.amount * a;
+            }
+        }
+    }
+
+    void ReactionNetwork::jacobian(std::span<const double_t> amounts, std::span<double_t> result) const {
+        auto n = species.size();
+        std::fill(result.begin(), result.end(), 0.0);
+
+        for (auto& reaction: reactions) {
+            if (!reaction.enabled) {
+                continue;
+            }
+            // The factors are the inputs followed by the catalysts, read in place so nothing is allocated
+            auto count = reaction.inputs.size() + reaction.catalysts.size();
+            auto factor = [&reaction](size_t k) {
+                return k < reaction.inputs.size() ? reaction.inputs[k].species : reaction.catalysts[k - reaction.inputs.size()].species;
+            };
+
+            // Product rule, a species can appear as both reactant and catalyst
+            for (size_t k = 0; k < count; ++k) {
+                auto partial = reaction.rate;
+                for (size_t m = 0; m < count; ++m) {
+                    if (m != k) {
+                        partial *= amounts[factor(m)];
+                    }
+                }
+                if (partial == 0) {
+                    continue;
+                }
+                for (auto& change: reaction.changes) {
+                    result[change.species * n + factor(k)] += change.amount * partial;
+                }
+            }
+        }
+    }
+
+    std::default_random_engine make_random_engine() {
+        auto thread_id = std::this_thread::get_id();
+        auto epoch = std::chrono::system_clock::now().time_since_epoch().count();
+        return std::default_random_engine(epoch * (std::hash<std::thread::id>{}(thread_id)));
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef SP_EXAM_PROJECT_NETWORK_H
+#define SP_EXAM_PROJECT_NETWORK_H
+
+#include "simulation.h"
+
+namespace StochasticSimulation {
+
+    // Species id (symbol id in the vessel's reactant table) together with an amount
+    struct SpeciesAmount {
+        size_t species;
+        double_t amount;
+    };
+
+    // Reaction with names resolved to species ids, the environment is left out
+    struct CompiledReaction {
+        std::vector<SpeciesAmount> inputs;     // reactants and the amount required of each
+        std::vector<SpeciesAmount> catalysts;  // catalysts and the amount required of each
+        std::vector<SpeciesAmount> changes;    // net change of every species touched when fired
+        double_t rate;
+        bool enabled{true};
+        std::vector<SpeciesAmount> products{};  // released on completion of a delayed reaction
+        std::optional<ReactionDelay> delay{};
+    };
+
+    // Index based form of a vessel used by the engines that do not work on names
+    class ReactionNetwork {
+    public:
+        SymbolTable<Reactant> species;
+        std::vector<CompiledReaction> reactions;
+        std::vector<Intervention> interventions;  // sorted by time
+
+        explicit ReactionNetwork(const Vessel& vessel);
+
+        // Changes a rate, the enabled flag of a reaction or an amount. Returns the reaction whose
+        // propensity changed, or for amount interventions the species whose dependents changed.
+        size_t apply(const Intervention& intervention, std::span<double_t> amounts);
+
+        [[nodiscard]] std::vector<double_t> initial_amounts() const;
+
+        // Same kinetics as Reaction::compute_delay: rate times the amounts of reactants and catalysts, 0 when disabled
+        [[nodiscard]] double_t propensity(size_t reaction, std::span<const double_t> amounts) const;
+
+        // Whether there is enough of every reactant and catalyst for the reaction to happen
+        [[nodiscard]] bool can_fire(size_t reaction, std::span<const double_t> amounts) const;
+
+        void fire(size_t reaction, std::span<double_t> amounts) const;
+
+        // The two halves of a delayed reaction: consuming the reactants and releasing the products
+        void start(size_t reaction, std::span<double_t> amounts) const;
+        void complete(size_t reaction, std::span<double_t> amounts) const;
+
+        [[nodiscard]] bool has_delays() const;
+
+        // Mean-field (reaction rate equation) derivative of every amount
+        void derivatives(std::span<const double_t> amounts, std::span<double_t> result) const;
+
+        // Row-major jacobian of derivatives(), result has species.size()^2 entries
+        void jacobian(std::span<const double_t> amounts, std::span<double_t> result) const;
+    };
+
+    // Random engine for one run, seeded from the clock and the running thread
+    std::default_random_engine make_random_engine();
+}
+
+#endif //SP_EXAM_PROJECT_NETWORK_H
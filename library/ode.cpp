@@ -0,0 +1,337 @@
+#include <stdexcept>
+#include "analysis.h"
+
+namespace StochasticSimulation {
+
+    namespace {
+        // Dormand-Prince 5(4) tableau
+        constexpr double_t a21 = 1.0 / 5.0;
+        constexpr double_t a31 = 3.0 / 40.0, a32 = 9.0 / 40.0;
+        constexpr double_t a41 = 44.0 / 45.0, a42 = -56.0 / 15.0, a43 = 32.0 / 9.0;
+        constexpr double_t a51 = 19372.0 / 6561.0, a52 = -25360.0 / 2187.0, a53 = 64448.0 / 6561.0, a54 = -212.0 / 729.0;
+        constexpr double_t a61 = 9017.0 / 3168.0, a62 = -355.0 / 33.0, a63 = 46732.0 / 5247.0, a64 = 49.0 / 176.0, a65 = -5103.0 / 18656.0;
+        constexpr double_t a71 = 35.0 / 384.0, a73 = 500.0 / 1113.0, a74 = 125.0 / 192.0, a75 = -2187.0 / 6784.0, a76 = 11.0 / 84.0;
+        constexpr double_t e1 = 71.0 / 57600.0, e3 = -71.0 / 16695.0, e4 = 71.0 / 1920.0, e5 = -17253.0 / 339200.0, e6 = 22.0 / 525.0, e7 = -1.0 / 40.0;
+
+        // Shampine's Rosenbrock 2(3) constants (as used by ode23s)
+        const double_t rosenbrock_d = 1.0 / (2.0 + std::sqrt(2.0));
+        const double_t rosenbrock_e32 = 6.0 + std::sqrt(2.0);
+
+        using vector_type = std::vector<double_t>;
+
+        double_t error_norm(const vector_type& y0, const vector_type& y1, const vector_type& error, const OdeOptions& options) {
+            double_t sum{0};
+            for (size_t i = 0; i < y0.size(); ++i) {
+                auto scale = options.absolute_tolerance + options.relative_tolerance * std::max(std::abs(y0[i]), std::abs(y1[i]));
+                sum += (error[i] / scale) * (error[i] / scale);
+            }
+            return y0.empty() ? 0 : std::sqrt(sum / y0.size());
+        }
+
+        // In place LU decomposition with partial pivoting of a row-major n x n matrix
+        void lu_decompose(vector_type& a, std::vector<size_t>& pivots, size_t n) {
+            for (size_t k = 0; k < n; ++k) {
+                auto pivot = k;
+                for (size_t i = k + 1; i < n; ++i) {
+                    if (std::abs(a[i * n + k]) > std::abs(a[pivot * n + k])) {
+                        pivot = i;
+                    }
+                }
+                if (a[pivot * n + k] == 0) {
+                    throw std::runtime_error("Singular iteration matrix in Rosenbrock step");
+                }
+                pivots[k] = pivot;
+                if (pivot != k) {
+                    for (size_t j = 0; j < n; ++j) {
+                        std::swap(a[k * n + j], a[pivot * n + j]);
+                    }
+                }
+                for (size_t i = k + 1; i < n; ++i) {
+                    auto factor = a[i * n + k] /= a[k * n + k];
+                    for (size_t j = k + 1; j < n; ++j) {
+                        a[i * n + j] -= factor * a[k * n + j];
+                    }
+                }
+            }
+        }
+
+        void lu_solve(const vector_type& lu, const std::vector<size_t>& pivots, vector_type& b, size_t n) {
+            for (size_t k = 0; k < n; ++k) {
+                std::swap(b[k], b[pivots[k]]);
+                for (size_t i = k + 1; i < n; ++i) {
+                    b[i] -= lu[i * n + k] * b[k];
+                }
+            }
+            for (size_t k = n; k-- > 0;) {
+                for (size_t j = k + 1; j < n; ++j) {
+                    b[k] -= lu[k * n + j] * b[j];
+                }
+                b[k] /= lu[k * n + k];
+            }
+        }
+
+        // Reaction rate equations on the independent species. Every conservation law determines its
+        // dependent species from the others, so only the independent ones are integrated.
+        class ReducedSystem {
+        private:
+            const ReactionNetwork& network;
+            std::vector<ConservationLaw> laws{};
+            std::vector<size_t> independent{};
+            vector_type full, full_derivatives, full_jacobian;
+        public:
+            explicit ReducedSystem(const ReactionNetwork& network):
+                network(network),
+                full(network.species.size()),
+                full_derivatives(network.species.size()),
+                full_jacobian(network.species.size() * network.species.size())
+            {
+                // Amount interventions break the laws of the species they change
+                std::vector<bool> changed(network.species.size(), false);
+                for (auto& intervention: network.interventions) {
+                    if (intervention.kind == Intervention::Kind::amount) {
+                        changed[intervention.target] = true;
+                    }
+                }
+
+                std::vector<bool> dependent(network.species.size(), false);
+                for (auto& law: find_conservation_laws(network)) {
+                    if (std::none_of(law.weights.begin(), law.weights.end(), [&changed](const SpeciesAmount& w){ return changed[w.species]; })) {
+                        dependent[law.dependent] = true;
+                        laws.push_back(std::move(law));
+                    }
+                }
+                for (size_t i = 0; i < network.species.size(); ++i) {
+                    if (!dependent[i]) {
+                        independent.push_back(i);
+                    }
+                }
+            }
+
+            [[nodiscard]] size_t size() const {
+                return independent.size();
+            }
+
+            void expand(std::span<const double_t> reduced, std::span<double_t> result) const {
+                for (size_t i = 0; i < independent.size(); ++i) {
+                    result[independent[i]] = reduced[i];
+                }
+                for (auto& law: laws) {
+                    auto value = law.total;
+                    for (auto& weight: law.weights) {
+                        if (weight.species != law.dependent) {
+                            value -= weight.amount * result[weight.species];
+                        }
+                    }
+                    result[law.dependent] = value;
+                }
+            }
+
+            void reduce(std::span<const double_t> amounts, std::span<double_t> result) const {
+                for (size_t i = 0; i < independent.size(); ++i) {
+                    result[i] = amounts[independent[i]];
+                }
+            }
+
+            void derivatives(std::span<const double_t> reduced, std::span<double_t> result) {
+                expand(reduced, full);
+                network.derivatives(full, full_derivatives);
+                reduce(full_derivatives, result);
+            }
+
+            // Chain rule through the dependent species, d dependent / d species = -weight of species
+            void jacobian(std::span<const double_t> reduced, std::span<double_t> result) {
+                auto n = network.species.size();
+                auto m = independent.size();
+                expand(reduced, full);
+                network.jacobian(full, full_jacobian);
+
+                for (size_t i = 0; i < m; ++i) {
+                    for (size_t j = 0; j < m; ++j) {
+                        result[i * m + j] = full_jacobian[independent[i] * n + independent[j]];
+                    }
+                }
+                for (auto& law: laws) {
+                    for (auto& weight: law.weights) {
+                        if (weight.species == law.dependent) {
+                            continue;
+                        }
+                        auto j = std::lower_bound(independent.begin(), independent.end(), weight.species) - independent.begin();
+                        for (size_t i = 0; i < m; ++i) {
+                            result[i * m + j] -= full_jacobian[independent[i] * n + law.dependent] * weight.amount;
+                        }
+                    }
+                }
+            }
+        };
+
+        class OdeIntegrator {
+        private:
+            ReducedSystem& system;
+            const OdeOptions& options;
+            size_t n;
+            vector_type k1, k2, k3, k4, k5, k6, k7, stage, error;
+            vector_type matrix;
+            std::vector<size_t> pivots;
+            bool k1_valid{false};
+        public:
+            OdeIntegrator(ReducedSystem& system, const OdeOptions& options):
+                system(system),
+                options(options),
+                n(system.size()),
+                k1(n), k2(n), k3(n), k4(n), k5(n), k6(n), k7(n), stage(n), error(n),
+                matrix(n * n), pivots(n)
+            {}
+
+            // Attempts a step of size h from y into result, returns the scaled error norm
+            double_t step(const vector_type& y, vector_type& result, double_t h) {
+                return options.method == OdeMethod::runge_kutta ? dormand_prince(y, result, h) : rosenbrock(y, result, h);
+            }
+
+            // After the amounts or rates were changed from outside
+            void restart() {
+                k1_valid = false;
+            }
+
+            // The last stage of an accepted Dormand-Prince step is the first of the next one
+            void accepted() {
+                if (options.method == OdeMethod::runge_kutta) {
+                    std::swap(k1, k7);
+                    k1_valid = true;
+                }
+            }
+
+        private:
+            double_t dormand_prince(const vector_type& y, vector_type& result, double_t h) {
+                if (!k1_valid) {
+                    system.derivatives(y, k1);
+                }
+
+                for (size_t i = 0; i < n; ++i) stage[i] = y[i] + h * a21 * k1[i];
+                system.derivatives(stage, k2);
+                for (size_t i = 0; i < n; ++i) stage[i] = y[i] + h * (a31 * k1[i] + a32 * k2[i]);
+                system.derivatives(stage, k3);
+                for (size_t i = 0; i < n; ++i) stage[i] = y[i] + h * (a41 * k1[i] + a42 * k2[i] + a43 * k3[i]);
+                system.derivatives(stage, k4);
+                for (size_t i = 0; i < n; ++i) stage[i] = y[i] + h * (a51 * k1[i] + a52 * k2[i] + a53 * k3[i] + a54 * k4[i]);
+                system.derivatives(stage, k5);
+                for (size_t i = 0; i < n; ++i) stage[i] = y[i] + h * (a61 * k1[i] + a62 * k2[i] + a63 * k3[i] + a64 * k4[i] + a65 * k5[i]);
+                system.derivatives(stage, k6);
+                for (size_t i = 0; i < n; ++i) result[i] = y[i] + h * (a71 * k1[i] + a73 * k3[i] + a74 * k4[i] + a75 * k5[i] + a76 * k6[i]);
+                system.derivatives(result, k7);
+
+                for (size_t i = 0; i < n; ++i) {
+                    error[i] = h * (e1 * k1[i] + e3 * k3[i] + e4 * k4[i] + e5 * k5[i] + e6 * k6[i] + e7 * k7[i]);
+                }
+                return error_norm(y, result, error, options);
+            }
+
+            double_t rosenbrock(const vector_type& y, vector_type& result, double_t h) {
+                // W = I - h d J
+                system.jacobian(y, matrix);
+                for (size_t i = 0; i < n * n; ++i) {
+                    matrix[i] *= -h * rosenbrock_d;
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    matrix[i * n + i] += 1.0;
+                }
+                lu_decompose(matrix, pivots, n);
+
+                // k4 holds f(y) and k5 holds f at the midpoint stage
+                system.derivatives(y, k4);
+                k1 = k4;
+                lu_solve(matrix, pivots, k1, n);
+
+                for (size_t i = 0; i < n; ++i) stage[i] = y[i] + 0.5 * h * k1[i];
+                system.derivatives(stage, k5);
+                for (size_t i = 0; i < n; ++i) k2[i] = k5[i] - k1[i];
+                lu_solve(matrix, pivots, k2, n);
+                for (size_t i = 0; i < n; ++i) k2[i] += k1[i];
+
+                for (size_t i = 0; i < n; ++i) result[i] = y[i] + h * k2[i];
+                system.derivatives(result, k6);
+                for (size_t i = 0; i < n; ++i) {
+                    k3[i] = k6[i] - rosenbrock_e32 * (k2[i] - k5[i]) - 2.0 * (k1[i] - k4[i]);
+                }
+                lu_solve(matrix, pivots, k3, n);
+
+                for (size_t i = 0; i < n; ++i) {
+                    error[i] = h / 6.0 * (k1[i] - 2.0 * k2[i] + k3[i]);
+                }
+                return error_norm(y, result, error, options);
+            }
+        };
+    }
+
+    // Deterministic mean-field simulation of the reaction rate equations
+    std::shared_ptr<SimulationTrajectory> Vessel::do_ode_simulation(double_t end_time, const OdeOptions& options, simulation_monitor& monitor) {
+        ReactionNetwork network{*this};
+        if (network.has_delays()) {
+            throw std::invalid_argument("Delayed reactions are not supported by the ODE simulation");
+        }
+        SimulationTrajectory trajectory{reactants};
+        trajectory.reserve(reserved_rows());
+        SimulationState state{reactants, 0};
+
+        ReducedSystem system{network};
+        auto amounts = network.initial_amounts();
+        vector_type y(system.size());
+        system.reduce(amounts, y);
+        auto y_new = y;
+        trajectory.insert(0, amounts);
+
+        OdeIntegrator integrator{system, options};
+        auto order = options.method == OdeMethod::runge_kutta ? 5.0 : 3.0;
+
+        double_t t{0};
+        double_t h{options.initial_step};
+        size_t steps{0};
+
+        auto& interventions = network.interventions;
+        size_t next_intervention{0};
+
+        while (t < end_time) {
+            if (++steps > options.max_steps) {
+                throw std::runtime_error("ODE simulation exceeded the maximum number of steps");
+            }
+
+            // Interventions are breakpoints, the integration restarts after them
+            if (next_intervention < interventions.size() && interventions[next_intervention].time <= t) {
+                while (next_intervention < interventions.size() && interventions[next_intervention].time <= t) {
+                    network.apply(interventions[next_intervention++], amounts);
+                }
+                system.reduce(amounts, y);
+                integrator.restart();
+                trajectory.insert(t, amounts);
+            }
+            auto stop = next_intervention < interventions.size() ? std::min(end_time, interventions[next_intervention].time) : end_time;
+
+            h = std::min({h, options.max_step, stop - t});
+            auto error = integrator.step(y, y_new, h);
+
+            if (error <= 1.0) {
+                t += h;
+                std::swap(y, y_new);
+                integrator.accepted();
+
+                system.expand(y, amounts);
+                trajectory.insert(t, amounts);
+
+                state.time = t;
+                for (size_t i = 0; i < amounts.size(); ++i) {
+                    state.reactants[Symbol{i}].amount = amounts[i];
+                }
+                monitor.monitor(state);
+            }
+
+            auto factor = !std::isfinite(error) ? 0.2 : error == 0 ? 5.0 : 0.9 * std::pow(error, -1.0 / order);
+            h *= std::clamp(factor, 0.2, 5.0);
+
+            if (h < 1e-14 * std::max(1.0, t)) {
+                throw std::runtime_error("ODE step size underflow at time " + std::to_string(t));
+            }
+        }
+
+        record_run(trajectory.size());
+        return std::make_shared<SimulationTrajectory>(std::move(trajectory));
+    }
+}
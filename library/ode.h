@@ -0,0 +1,24 @@
+#ifndef SP_EXAM_PROJECT_ODE_H
+#define SP_EXAM_PROJECT_ODE_H
+
+#include <cmath>
+#include <cstddef>
+
+namespace StochasticSimulation {
+
+    enum class OdeMethod {
+        runge_kutta, // explicit Dormand-Prince 5(4)
+        rosenbrock   // linearly implicit Rosenbrock 2(3), for stiff networks
+    };
+
+    struct OdeOptions {
+        OdeMethod method{OdeMethod::runge_kutta};
+        double_t relative_tolerance{1e-6};
+        double_t absolute_tolerance{1e-6};
+        double_t initial_step{1e-4};
+        double_t max_step{1.0};
+        size_t max_steps{10000000};
+    };
+}
+
+#endif //SP_EXAM_PROJECT_ODE_H
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "placement.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#define THREAD_PLACEMENT_SUPPORTED
+#endif
+
+namespace StochasticSimulation {
+
+    namespace {
+        // Parses a kernel cpu list such as "0-15,32-47"
+        std::vector<size_t> parse_cpu_list(const std::string& list) {
+            std::vector<size_t> cpus{};
+            std::stringstream stream{list};
+            std::string range;
+            while (std::getline(stream, range, ',')) {
+                if (range.find_first_of("0123456789") == std::string::npos) {
+                    continue;
+                }
+                auto dash = range.find('-');
+                auto first = std::stoul(range.substr(0, dash));
+                auto last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+                for (auto cpu = first; cpu <= last; ++cpu) {
+                    cpus.push_back(cpu);
+                }
+            }
+            return cpus;
+        }
+
+        std::vector<size_t> allowed_cpus() {
+            std::vector<size_t> cpus{};
+#ifdef THREAD_PLACEMENT_SUPPORTED
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+                for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                    if (CPU_ISSET(cpu, &set)) {
+                        cpus.push_back(cpu);
+                    }
+                }
+            }
+#endif
+            if (cpus.empty()) {
+                for (size_t cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+                    cpus.push_back(cpu);
+                }
+            }
+            return cpus;
+        }
+
+        std::string format_cpus(const std::vector<size_t>& cpus) {
+            std::stringstream s;
+            for (size_t i = 0; i < cpus.size(); ++i) {
+                auto last = i;
+                while (last + 1 < cpus.size() && cpus[last + 1] == cpus[last] + 1) {
+                    last++;
+                }
+                s << (i == 0 ? "" : ",") << cpus[i];
+                if (last != i) {
+                    s << "-" << cpus[last];
+                }
+                i = last;
+            }
+            return s.str();
+        }
+    }
+
+    std::vector<NumaNode> numa_topology() {
+        auto allowed = allowed_cpus();
+        std::vector<NumaNode> nodes{};
+
+        std::error_code error;
+        for (auto& entry: std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+            auto name = entry.path().filename().string();
+            if (name.size() <= 4 || name.rfind("node", 0) != 0 || !std::all_of(name.begin() + 4, name.end(), [](unsigned char c){ return std::isdigit(c); })) {
+                continue;
+            }
+
+            std::ifstream file{entry.path() / "cpulist"};
+            std::string list;
+            std::getline(file, list);
+
+            NumaNode node{std::stoul(name.substr(4)), {}};
+            for (auto cpu: parse_cpu_list(list)) {
+                if (std::binary_search(allowed.begin(), allowed.end(), cpu)) {
+                    node.cpus.push_back(cpu);
+                }
+            }
+            if (!node.cpus.empty()) {
+                nodes.push_back(std::move(node));
+            }
+        }
+
+        if (nodes.empty()) {
+            nodes.push_back({0, allowed});
+        }
+        std::sort(nodes.begin(), nodes.end(), [](const NumaNode& a, const NumaNode& b){ return a.id < b.id; });
+        return nodes;
+    }
+
+    bool pin_current_thread(const std::vector<size_t>& cpus) {
+#ifdef THREAD_PLACEMENT_SUPPORTED
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu: cpus) {
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        return false;
+#endif
+    }
+
+    std::optional<size_t> current_cpu() {
+#ifdef THREAD_PLACEMENT_SUPPORTED
+        auto cpu = sched_getcpu();
+        if (cpu >= 0) {
+            return static_cast<size_t>(cpu);
+        }
+#endif
+        return std::nullopt;
+    }
+
+    PlacementPlan::PlacementPlan(ThreadPlacement placement): placement(placement), nodes(numa_topology()) {
+        size_t longest{0};
+        for (auto& node: nodes) {
+            longest = std::max(longest, node.cpus.size());
+        }
+        for (size_t i = 0; i < longest; ++i) {
+            for (size_t n = 0; n < nodes.size(); ++n) {
+                if (i < nodes[n].cpus.size()) {
+                    order.emplace_back(n, nodes[n].cpus[i]);
+                }
+            }
+        }
+    }
+
+    WorkerPlacement PlacementPlan::apply(size_t worker) const {
+        WorkerPlacement result{worker, std::nullopt, {}, std::nullopt, 0};
+        if (placement != ThreadPlacement::unpinned) {
+            auto [node, cpu] = order[worker % order.size()];
+            auto cpus = placement == ThreadPlacement::cpus ? std::vector<size_t>{cpu} : nodes[node].cpus;
+            if (pin_current_thread(cpus)) {
+                result.node = nodes[node].id;
+                result.cpus = std::move(cpus);
+            }
+        }
+        result.cpu = current_cpu();
+        return result;
+    }
+
+    std::ostream& operator<<(std::ostream& s, const PlacementReport& report) {
+        s << "NUMA nodes:";
+        for (auto& node: report.nodes) {
+            s << " " << node.id << " (cpus " << format_cpus(node.cpus) << ")";
+        }
+        s << std::endl;
+
+        for (auto& worker: report.workers) {
+            s << "\tworker " << worker.worker << ": ";
+            if (worker.cpus.empty()) {
+                s << "unpinned";
+            } else {
+                s << "node " << worker.node.value() << ", cpus " << format_cpus(worker.cpus);
+            }
+            if (worker.cpu.has_value()) {
+                s << ", started on cpu " << worker.cpu.value();
+            }
+            s << ", " << worker.runs << " runs" << std::endl;
+        }
+        return s;
+    }
+}
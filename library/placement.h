@@ -0,0 +1,73 @@
+#ifndef SP_EXAM_PROJECT_PLACEMENT_H
+#define SP_EXAM_PROJECT_PLACEMENT_H
+
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+namespace StochasticSimulation {
+
+    // Where the workers of an ensemble run
+    enum class ThreadPlacement {
+        unpinned,    // left to the scheduler
+        cpus,        // every worker pinned to one cpu
+        numa_nodes   // every worker pinned to the cpus of one NUMA node
+    };
+
+    struct NumaNode {
+        size_t id;
+        std::vector<size_t> cpus;  // only the cpus this process may run on
+    };
+
+    // NUMA nodes from /sys/devices/system/node, a single node with every allowed cpu when that is not available
+    std::vector<NumaNode> numa_topology();
+
+    // Pins the calling thread, false when the platform does not support it or the cpus are rejected
+    bool pin_current_thread(const std::vector<size_t>& cpus);
+
+    // cpu the calling thread runs on right now, if the platform can tell
+    std::optional<size_t> current_cpu();
+
+    struct WorkerPlacement {
+        size_t worker;
+        std::optional<size_t> node;   // node the worker was assigned to, none when unpinned
+        std::vector<size_t> cpus;     // cpus the worker was pinned to, empty when unpinned or pinning failed
+        std::optional<size_t> cpu;    // cpu the worker started on
+        size_t runs{0};
+    };
+
+    // Placement used by an ensemble, filled in by the workers
+    struct PlacementReport {
+        ThreadPlacement placement{ThreadPlacement::unpinned};
+        std::vector<NumaNode> nodes{};
+        std::vector<WorkerPlacement> workers{};
+
+        friend std::ostream& operator<<(std::ostream& s, const PlacementReport& report);
+    };
+
+    // Assigns workers to cpus or nodes in turn over the nodes, so a small ensemble is spread over all of them
+    class PlacementPlan {
+    private:
+        ThreadPlacement placement;
+        std::vector<NumaNode> nodes;
+        std::vector<std::pair<size_t, size_t>> order{};  // (node index, cpu) interleaved over the nodes
+    public:
+        explicit PlacementPlan(ThreadPlacement placement);
+
+        // Pins the calling thread as worker number worker, to be called before it allocates its buffers
+        WorkerPlacement apply(size_t worker) const;
+
+        // Cpus the workers can be pinned to
+        [[nodiscard]] size_t cpu_count() const {
+            return order.size();
+        }
+
+        [[nodiscard]] PlacementReport report() const {
+            return {placement, nodes, {}};
+        }
+    };
+}
+
+#endif //SP_EXAM_PROJECT_PLACEMENT_H
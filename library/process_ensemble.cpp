@@ -0,0 +1,181 @@
+#include <cerrno>
+#include <stdexcept>
+#include "stepper.h"
+#include "cache.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define PROCESS_ENSEMBLE_SUPPORTED
+#endif
+
+namespace StochasticSimulation {
+
+    SimulationTrajectory EnsembleStatistics::mean_trajectory() const {
+        SimulationTrajectory trajectory{species};
+        trajectory.reserve(times.size());
+        for (size_t i = 0; i < times.size(); ++i) {
+            trajectory.insert(times[i], {mean.data() + i * species.size(), species.size()});
+        }
+        return trajectory;
+    }
+
+#ifdef PROCESS_ENSEMBLE_SUPPORTED
+    namespace {
+        // Block of the shared segment written by one worker: the runs it completed followed by
+        // the sums and sums of squares of every amount at every grid point
+        struct WorkerBlock {
+            double_t* base;
+            size_t cells;
+
+            double_t& runs() { return base[0]; }
+            double_t* sums() { return base + 1; }
+            double_t* squares() { return base + 1 + cells; }
+        };
+
+        // Every run is seeded from the ensemble seed and its own index, so the result does not depend on
+        // how the runs are split over the workers
+        uint32_t run_seed(uint64_t seed, size_t run) {
+            std::seed_seq sequence{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32),
+                                   static_cast<uint32_t>(run), static_cast<uint32_t>(static_cast<uint64_t>(run) >> 32)};
+            uint32_t result{0};
+            sequence.generate(&result, &result + 1);
+            return result;
+        }
+
+        // Waits for the worker to exit, a wait interrupted by a signal is retried. False if the worker
+        // failed or could not be waited for.
+        bool wait_for(pid_t worker) {
+            int status{0};
+            pid_t waited{};
+            do {
+                waited = waitpid(worker, &status, 0);
+            } while (waited == -1 && errno == EINTR);
+            return waited == worker && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+
+        void run_worker(const ReactionNetwork& network, WorkerBlock block, const std::vector<double_t>& times, size_t first_run, size_t runs, uint64_t seed, SsaEngine selection) {
+            auto width = network.species.size();
+
+            for (size_t run = first_run; run < first_run + runs; ++run) {
+                DirectMethodStepper stepper{network, std::default_random_engine{run_seed(seed, run)}, selection};
+
+                // Statistics are sampled while stepping, no trajectory is kept
+                for (size_t point = 0; point < times.size(); ++point) {
+                    while (stepper.step(times[point])) {}
+                    for (size_t i = 0; i < width; ++i) {
+                        auto amount = stepper.amounts[i];
+                        block.sums()[point * width + i] += amount;
+                        block.squares()[point * width + i] += amount * amount;
+                    }
+                }
+                block.runs() += 1;
+            }
+        }
+    }
+
+    EnsembleStatistics Vessel::do_multiple_process_simulations(double_t end_time, size_t simulations_to_run, const ProcessEnsembleOptions& options) const {
+        ReactionNetwork network{*this};
+        auto width = network.species.size();
+
+        EnsembleStatistics statistics{network.species};
+        statistics.requested = simulations_to_run;
+        for (size_t point = 0; point <= options.grid_points; ++point) {
+            statistics.times.push_back(end_time * static_cast<double_t>(point) / static_cast<double_t>(options.grid_points));
+        }
+        auto cells = statistics.times.size() * width;
+
+        auto processes = options.processes == 0 ? std::max<size_t>(1, std::thread::hardware_concurrency()) : options.processes;
+        processes = std::max<size_t>(1, std::min(processes, simulations_to_run));
+
+        std::optional<uint64_t> key{};
+        if (options.cache != nullptr) {
+            if (!options.seed.has_value()) {
+                throw std::invalid_argument("Only ensembles with a seed can be cached");
+            }
+            key = ensemble_key(network, end_time, simulations_to_run, options.grid_points, options.selection, options.seed.value());
+            if (auto cached = options.cache->load(key.value())) {
+                return std::move(cached.value());
+            }
+        }
+
+        // The segment is mapped before forking so parent and workers share it
+        auto block_size = 1 + 2 * cells;
+        auto bytes = processes * block_size * sizeof(double_t);
+        auto* segment = static_cast<double_t*>(mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+        if (segment == MAP_FAILED) {
+            throw std::runtime_error("Could not map shared memory for the process ensemble");
+        }
+
+        auto seed = options.seed.has_value() ? options.seed.value() : std::random_device{}();
+        std::vector<pid_t> workers{};
+
+        for (size_t worker = 0, first_run = 0; worker < processes; ++worker) {
+            auto runs = simulations_to_run / processes + (worker < simulations_to_run % processes ? 1 : 0);
+            WorkerBlock block{segment + worker * block_size, cells};
+
+            auto pid = fork();
+            if (pid == 0) {
+                // An exception must not unwind into the copy of the caller, the worker fails instead
+                try {
+                    run_worker(network, block, statistics.times, first_run, runs, seed, options.selection);
+                } catch (...) {
+                    _exit(1);
+                }
+                _exit(0);
+            }
+            if (pid < 0) {
+                for (auto started: workers) {
+                    wait_for(started);
+                }
+                munmap(segment, bytes);
+                throw std::runtime_error("Could not start worker process");
+            }
+            workers.push_back(pid);
+            first_run += runs;
+        }
+
+        std::vector<double_t> sums(cells, 0.0);
+        std::vector<double_t> squares(cells, 0.0);
+
+        for (size_t worker = 0; worker < workers.size(); ++worker) {
+            if (!wait_for(workers[worker])) {
+                continue;
+            }
+
+            WorkerBlock block{segment + worker * block_size, cells};
+            statistics.runs += static_cast<size_t>(block.runs());
+            for (size_t i = 0; i < cells; ++i) {
+                sums[i] += block.sums()[i];
+                squares[i] += block.squares()[i];
+            }
+        }
+        munmap(segment, bytes);
+
+        statistics.mean.assign(cells, 0.0);
+        statistics.variance.assign(cells, 0.0);
+        if (statistics.runs > 0) {
+            auto n = static_cast<double_t>(statistics.runs);
+            for (size_t i = 0; i < cells; ++i) {
+                statistics.mean[i] = sums[i] / n;
+                statistics.variance[i] = statistics.runs > 1 ? std::max(0.0, (squares[i] - sums[i] * sums[i] / n) / (n - 1)) : 0.0;
+            }
+        }
+
+        // An ensemble with crashed workers is incomplete and is not stored. The cache is only an
+        // optimisation, an entry that cannot be written does not lose the result.
+        if (key.has_value() && statistics.complete()) {
+            try {
+                options.cache->store(key.value(), statistics);
+            } catch (const std::exception&) {}
+        }
+
+        return statistics;
+    }
+#else
+    EnsembleStatistics Vessel::do_multiple_process_simulations(double_t, size_t, const ProcessEnsembleOptions&) const {
+        throw std::runtime_error("Process ensembles need fork and shared memory, which this platform does not provide");
+    }
+#endif
+}
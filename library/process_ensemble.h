@@ -0,0 +1,23 @@
+#ifndef SP_EXAM_PROJECT_PROCESS_ENSEMBLE_H
+#define SP_EXAM_PROJECT_PROCESS_ENSEMBLE_H
+
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include "selection.h"
+
+namespace StochasticSimulation {
+
+    class EnsembleCache;
+
+    struct ProcessEnsembleOptions {
+        size_t processes{0};        // 0 starts one worker process per core
+        size_t grid_points{1000};   // intervals of the even time grid the statistics are gathered on
+        std::optional<uint64_t> seed{};
+        SsaEngine selection{SsaEngine::direct};
+        // Identical ensembles are loaded from the cache instead of simulated, needs a seed
+        const EnsembleCache* cache{nullptr};
+    };
+}
+
+#endif //SP_EXAM_PROJECT_PROCESS_ENSEMBLE_H
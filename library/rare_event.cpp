@@ -0,0 +1,229 @@
+#include <limits>
+#include <stdexcept>
+#include "rare_event.h"
+#include "stepper.h"
+
+namespace StochasticSimulation {
+
+    namespace {
+        uint64_t base_seed(const std::optional<uint64_t>& seed) {
+            if (seed.has_value()) {
+                return seed.value();
+            }
+            std::random_device device{};
+            return (static_cast<uint64_t>(device()) << 32) | device();
+        }
+
+        // Engine of run i, independent of which thread runs it
+        std::default_random_engine run_engine(uint64_t base, size_t run) {
+            std::seed_seq sequence{static_cast<uint32_t>(base), static_cast<uint32_t>(base >> 32), static_cast<uint32_t>(run)};
+            return std::default_random_engine{sequence};
+        }
+
+        // Engine for a new trajectory, the outputs are mixed through a seed sequence since engines seeded
+        // with consecutive outputs of a linear congruential engine produce shifted copies of one stream
+        std::default_random_engine split_engine(std::default_random_engine& engine) {
+            std::seed_seq sequence{engine(), engine()};
+            return std::default_random_engine{sequence};
+        }
+
+        // Calls body(i) for every i below n, split into contiguous blocks over async workers
+        void parallel_for(size_t n, size_t threads, const std::function<void(size_t)>& body) {
+            auto jobs = threads == 0 ? std::max<size_t>(1, std::thread::hardware_concurrency()) : threads;
+            jobs = std::max<size_t>(1, std::min(jobs, n));
+
+            auto futures = std::vector<std::future<void>>{};
+            for (size_t job = 0; job < jobs; ++job) {
+                futures.push_back(std::async(std::launch::async, [&body, begin = n * job / jobs, end = n * (job + 1) / jobs]() {
+                    for (auto i = begin; i < end; ++i) {
+                        body(i);
+                    }
+                }));
+            }
+            for (auto& future: futures) {
+                future.get();
+            }
+        }
+
+        double_t mean_of(const std::vector<double_t>& values) {
+            return std::accumulate(values.begin(), values.end(), 0.0) / static_cast<double_t>(values.size());
+        }
+
+        // Variance of the mean of independent values
+        double_t variance_of_mean(const std::vector<double_t>& values) {
+            auto mean = mean_of(values);
+            double_t sum{0};
+            for (auto value: values) {
+                sum += (value - mean) * (value - mean);
+            }
+            return sum / static_cast<double_t>(values.size() - 1) / static_cast<double_t>(values.size());
+        }
+
+        // Likelihood ratio of the run if it reached the level, 0 otherwise
+        double_t weighted_run(ReactionNetwork network, const std::vector<double_t>& biases, double_t end_time,
+                              const EventScore& score, double_t level, std::default_random_engine engine, size_t& events) {
+            auto amounts = network.initial_amounts();
+            std::vector<double_t> propensities(network.reactions.size());
+            std::vector<double_t> biased(network.reactions.size());
+
+            auto& interventions = network.interventions;
+            size_t next_intervention{0};
+            double_t t{0};
+            double_t weight{1};
+
+            if (score(TrajectoryPoint{t, amounts}) >= level) {
+                return weight;
+            }
+
+            while (true) {
+                double_t total{0};
+                double_t biased_total{0};
+                for (size_t r = 0; r < propensities.size(); ++r) {
+                    propensities[r] = network.propensity(r, amounts);
+                    biased[r] = propensities[r] * biases[r];
+                    total += propensities[r];
+                    biased_total += biased[r];
+                }
+
+                auto intervention_time = next_intervention < interventions.size()
+                        ? interventions[next_intervention].time
+                        : std::numeric_limits<double_t>::infinity();
+                auto delay = total > 0 ? std::exponential_distribution<double_t>(total)(engine) : std::numeric_limits<double_t>::infinity();
+
+                if (t + delay > std::min(end_time, intervention_time)) {
+                    if (intervention_time > end_time) {
+                        return 0;
+                    }
+                    t = std::max(t, intervention_time);
+                    while (next_intervention < interventions.size() && interventions[next_intervention].time == intervention_time) {
+                        network.apply(interventions[next_intervention++], amounts);
+                    }
+                } else {
+                    t += delay;
+
+                    // The reaction is picked with the biased propensities
+                    auto target = std::uniform_real_distribution<double_t>(0.0, biased_total)(engine);
+                    size_t selected{0};
+                    double_t sum{0};
+                    for (size_t r = 0; r < biased.size(); ++r) {
+                        if (biased[r] > 0) {
+                            selected = r;
+                            sum += biased[r];
+                            if (target < sum) {
+                                break;
+                            }
+                        }
+                    }
+
+                    weight *= (propensities[selected] / total) / (biased[selected] / biased_total);
+                    if (network.can_fire(selected, amounts)) {
+                        network.fire(selected, amounts);
+                    }
+                    events++;
+                }
+
+                if (score(TrajectoryPoint{t, amounts}) >= level) {
+                    return weight;
+                }
+            }
+        }
+
+        // One fixed effort splitting estimate
+        double_t splitting_replication(const ReactionNetwork& network, const std::vector<double_t>& levels, double_t end_time,
+                                       const EventScore& score, size_t trajectories, std::default_random_engine engine,
+                                       size_t& runs, size_t& events) {
+            std::vector<DirectMethodStepper> current{};
+            current.reserve(trajectories);
+            for (size_t i = 0; i < trajectories; ++i) {
+                current.emplace_back(network, split_engine(engine));
+            }
+
+            double_t estimate{1};
+            for (size_t k = 0; k < levels.size(); ++k) {
+                std::vector<DirectMethodStepper> reached{};
+                runs += current.size();
+
+                for (auto& stepper: current) {
+                    auto before = stepper.events;
+                    auto hit = score(TrajectoryPoint{stepper.time, stepper.amounts}) >= levels[k];
+                    while (!hit && stepper.step(end_time)) {
+                        hit = score(TrajectoryPoint{stepper.time, stepper.amounts}) >= levels[k];
+                    }
+                    events += stepper.events - before;
+
+                    if (hit) {
+                        reached.push_back(std::move(stepper));
+                    }
+                }
+
+                estimate *= static_cast<double_t>(reached.size()) / static_cast<double_t>(trajectories);
+                if (reached.empty() || k + 1 == levels.size()) {
+                    break;
+                }
+
+                // Start the next stage from states picked uniformly among those that reached the level
+                current.clear();
+                std::uniform_int_distribution<size_t> pick(0, reached.size() - 1);
+                for (size_t i = 0; i < trajectories; ++i) {
+                    auto& clone = current.emplace_back(reached[pick(engine)]);
+                    clone.reseed(split_engine(engine));
+                }
+            }
+
+            return estimate;
+        }
+    }
+
+    RareEventEstimate estimate_weighted_ssa(const Vessel& vessel, double_t end_time, const EventScore& score, double_t level,
+                                            const WeightedSsaOptions& options) {
+        ReactionNetwork network{vessel};
+        if (network.has_delays()) {
+            throw std::invalid_argument("Delayed reactions are not supported by the weighted SSA");
+        }
+        if (options.runs < 2) {
+            throw std::invalid_argument("At least two runs are needed to estimate a variance");
+        }
+
+        auto biases = options.biases;
+        biases.resize(network.reactions.size(), 1.0);
+        if (std::any_of(biases.begin(), biases.end(), [](double_t bias){ return !(bias > 0); })) {
+            throw std::invalid_argument("Biases must be positive");
+        }
+
+        auto base = base_seed(options.seed);
+        std::vector<double_t> weights(options.runs);
+        std::vector<size_t> events(options.runs);
+
+        parallel_for(options.runs, options.threads, [&](size_t run) {
+            weights[run] = weighted_run(network, biases, end_time, score, level, run_engine(base, run), events[run]);
+        });
+
+        return {mean_of(weights), variance_of_mean(weights), options.runs, std::accumulate(events.begin(), events.end(), size_t{0})};
+    }
+
+    RareEventEstimate estimate_splitting(const Vessel& vessel, double_t end_time, const EventScore& score, double_t level,
+                                         const SplittingOptions& options) {
+        auto levels = options.levels;
+        levels.push_back(level);
+        if (std::adjacent_find(levels.begin(), levels.end(), std::greater_equal<>{}) != levels.end()) {
+            throw std::invalid_argument("Splitting levels must increase towards the rare level");
+        }
+        if (options.replications < 2 || options.trajectories == 0) {
+            throw std::invalid_argument("At least two replications with one trajectory are needed");
+        }
+
+        ReactionNetwork network{vessel};
+        auto base = base_seed(options.seed);
+        std::vector<double_t> estimates(options.replications);
+        std::vector<size_t> runs(options.replications);
+        std::vector<size_t> events(options.replications);
+
+        parallel_for(options.replications, options.threads, [&](size_t replication) {
+            estimates[replication] = splitting_replication(network, levels, end_time, score, options.trajectories,
+                                                           run_engine(base, replication), runs[replication], events[replication]);
+        });
+
+        return {mean_of(estimates), variance_of_mean(estimates), std::accumulate(runs.begin(), runs.end(), size_t{0}),
+                std::accumulate(events.begin(), events.end(), size_t{0})};
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef SP_EXAM_PROJECT_RARE_EVENT_H
+#define SP_EXAM_PROJECT_RARE_EVENT_H
+
+#include "simulation.h"
+
+namespace StochasticSimulation {
+
+    // Score of a state, the rare event is the score reaching a level before the end time. A simple
+    // score is the amount of a species, point[symbol].
+    using EventScore = std::function<double_t(const TrajectoryPoint&)>;
+
+    struct RareEventEstimate {
+        double_t probability;
+        double_t variance;  // of the probability estimate
+        size_t runs;        // simulated runs, clones included
+        size_t events;      // reactions simulated in total, to compare the cost with plain sampling
+    };
+
+    struct WeightedSsaOptions {
+        std::vector<double_t> biases{};  // propensity multiplier per reaction, missing ones are 1
+        size_t runs{10000};
+        size_t threads{0};               // 0 uses one thread per core
+        std::optional<uint64_t> seed{};
+    };
+
+    struct SplittingOptions {
+        std::vector<double_t> levels{};  // increasing intermediate levels of the score below the rare level
+        size_t trajectories{1000};       // simulated from each level to the next
+        size_t replications{8};          // independent estimates, their spread gives the variance
+        size_t threads{0};               // 0 uses one thread per core
+        std::optional<uint64_t> seed{};
+    };
+
+    // Weighted SSA (Kuwahara and Mura): waiting times are sampled as in the direct method but the
+    // reaction is chosen with biased propensities, every run carries the likelihood ratio of its
+    // choices so the mean weight of the runs reaching the level is unbiased
+    RareEventEstimate estimate_weighted_ssa(const Vessel& vessel, double_t end_time, const EventScore& score, double_t level,
+                                            const WeightedSsaOptions& options = {});
+
+    // Fixed effort multilevel splitting: trajectories reaching a level are cloned to start the same number
+    // of trajectories towards the next level, the probability is the product of the fractions reaching
+    // each level. Replications are independent, so their mean is unbiased and has a proper variance.
+    RareEventEstimate estimate_splitting(const Vessel& vessel, double_t end_time, const EventScore& score, double_t level,
+                                         const SplittingOptions& options = {});
+}
+
+#endif //SP_EXAM_PROJECT_RARE_EVENT_H
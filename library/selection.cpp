@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <bit>
+#include <numeric>
+#include "selection.h"
+
+namespace StochasticSimulation {
+
+    namespace {
+        // Bins cover every exponent of a positive double
+        constexpr size_t bin_count = 2200;
+
+        int exponent_of(double_t propensity) {
+            int exponent;
+            std::frexp(propensity, &exponent);
+            return exponent;
+        }
+    }
+
+    PropensityIndex::PropensityIndex(SsaEngine engine, size_t reactions):
+        engine(engine),
+        propensities(reactions, 0.0)
+    {
+        if (engine == SsaEngine::logarithmic_direct) {
+            tree.assign(reactions + 1, 0.0);
+            top_bit = 1;
+            while (top_bit * 2 <= reactions) {
+                top_bit *= 2;
+            }
+        } else if (engine == SsaEngine::composition_rejection) {
+            bins.resize(bin_count);
+            occupied.assign((bin_count + 63) / 64, 0);
+            pool.assign(reactions, 0);
+            bin_of.assign(reactions, no_bin);
+            position.assign(reactions, 0);
+        }
+    }
+
+    void PropensityIndex::tree_add(size_t reaction, double_t delta) {
+        for (auto i = reaction + 1; i < tree.size(); i += i & (~i + 1)) {
+            tree[i] += delta;
+        }
+    }
+
+    void PropensityIndex::place(size_t reaction, size_t at) {
+        pool[at] = reaction;
+        position[reaction] = at;
+    }
+
+    // First bin from the given one on with members, bins.size() if there is none
+    size_t PropensityIndex::next_occupied(size_t from) const {
+        auto word = from / 64;
+        if (word >= occupied.size()) {
+            return bins.size();
+        }
+        auto bits = occupied[word] & (~uint64_t{0} << (from % 64));
+        while (bits == 0) {
+            if (++word == occupied.size()) {
+                return bins.size();
+            }
+            bits = occupied[word];
+        }
+        return word * 64 + static_cast<size_t>(std::countr_zero(bits));
+    }
+
+    // The bins share one pool holding their members back to back in bin order. Removing a member leaves a
+    // hole at the end of its bin, every later bin moves its last member into the hole before it, which
+    // shifts the hole to the end of the pool. Only the bins with members are visited.
+    void PropensityIndex::bin_remove(size_t reaction) {
+        auto index = static_cast<size_t>(bin_of[reaction]);
+        auto& bin = bins[index];
+        auto hole = bin.start + bin.size - 1;
+        place(pool[hole], position[reaction]);
+        bin.size--;
+        bin.sum = bin.size == 0 ? 0.0 : bin.sum - propensities[reaction];
+        if (bin.size == 0) {
+            occupied[index / 64] &= ~(uint64_t{1} << (index % 64));
+        }
+
+        for (auto b = next_occupied(index + 1); b < bins.size(); b = next_occupied(b + 1)) {
+            auto& later = bins[b];
+            place(pool[later.start + later.size - 1], hole);
+            later.start = hole;
+            hole += later.size;
+        }
+        pooled--;
+        bin_of[reaction] = no_bin;
+    }
+
+    // The reverse of removing: the reaction takes the first place of the next bin, whose first member
+    // moves to the end of that bin, and so on until the last member moves to the end of the pool
+    void PropensityIndex::bin_insert(size_t reaction, double_t propensity) {
+        auto index = static_cast<size_t>(exponent_of(propensity) - lowest_exponent);
+        auto& bin = bins[index];
+        if (bin.size == 0) {
+            auto next = next_occupied(index + 1);
+            bin.start = next < bins.size() ? bins[next].start : pooled;
+            occupied[index / 64] |= uint64_t{1} << (index % 64);
+        }
+
+        auto at = bin.start + bin.size;
+        auto carried = reaction;
+        for (auto b = next_occupied(index + 1); b < bins.size(); b = next_occupied(b + 1)) {
+            auto& later = bins[b];
+            auto displaced = pool[later.start];
+            place(carried, at);
+            carried = displaced;
+            later.start++;
+            at = later.start + later.size - 1;
+        }
+        place(carried, at);
+        pooled++;
+
+        bin.size++;
+        bin.sum += propensity;
+        bin_of[reaction] = static_cast<int>(index);
+    }
+
+    void PropensityIndex::update(size_t reaction, double_t propensity) {
+        auto delta = propensity - propensities[reaction];
+        if (delta == 0) {
+            return;
+        }
+
+        if (engine == SsaEngine::logarithmic_direct) {
+            tree_add(reaction, delta);
+        } else if (engine == SsaEngine::composition_rejection) {
+            auto same_bin = propensity > 0 && bin_of[reaction] == static_cast<int>(exponent_of(propensity) - lowest_exponent);
+            if (same_bin) {
+                bins[bin_of[reaction]].sum += delta;
+            } else {
+                if (bin_of[reaction] != no_bin) {
+                    bin_remove(reaction);
+                }
+                if (propensity > 0) {
+                    bin_insert(reaction, propensity);
+                }
+            }
+        }
+
+        propensities[reaction] = propensity;
+        sum += delta;
+    }
+
+    void PropensityIndex::rebuild() {
+        sum = std::accumulate(propensities.begin(), propensities.end(), 0.0);
+
+        if (engine == SsaEngine::logarithmic_direct) {
+            // Linear time construction, every node passes its sum on to its parent
+            for (size_t i = 1; i < tree.size(); ++i) {
+                tree[i] = propensities[i - 1];
+            }
+            for (size_t i = 1; i < tree.size(); ++i) {
+                auto parent = i + (i & (~i + 1));
+                if (parent < tree.size()) {
+                    tree[parent] += tree[i];
+                }
+            }
+        } else if (engine == SsaEngine::composition_rejection) {
+            for (auto b = next_occupied(0); b < bins.size(); b = next_occupied(b + 1)) {
+                auto& bin = bins[b];
+                bin.sum = 0;
+                for (auto i = bin.start; i < bin.start + bin.size; ++i) {
+                    bin.sum += propensities[pool[i]];
+                }
+            }
+        }
+    }
+
+    size_t PropensityIndex::select_linear(double_t target) const {
+        double_t partial{0};
+        size_t last{0};
+        for (size_t r = 0; r < propensities.size(); ++r) {
+            if (propensities[r] > 0) {
+                partial += propensities[r];
+                last = r;
+                if (target < partial) {
+                    return r;
+                }
+            }
+        }
+        return last;
+    }
+
+    size_t PropensityIndex::select_tree(double_t target) const {
+        // Smallest reaction whose prefix sum exceeds the target
+        auto remaining = target;
+        size_t found{0};
+        for (auto step = top_bit; step > 0; step >>= 1) {
+            if (found + step < tree.size() && tree[found + step] <= remaining) {
+                found += step;
+                remaining -= tree[found];
+            }
+        }
+        found = std::min(found, propensities.size() - 1);
+
+        // Rounding can end the search on a reaction that cannot fire
+        if (propensities[found] == 0) {
+            return select_linear(std::min(target, sum));
+        }
+        return found;
+    }
+
+    size_t PropensityIndex::select_binned(std::default_random_engine& random) const {
+        // Composition: a bin in proportion to its sum, rounding can leave the target past the last bin
+        auto target = std::uniform_real_distribution<double_t>(0.0, sum)(random);
+        auto chosen = bins.size();
+        for (auto b = next_occupied(0); b < bins.size(); b = next_occupied(b + 1)) {
+            chosen = b;
+            if (target < bins[b].sum) {
+                break;
+            }
+            target -= bins[b].sum;
+        }
+
+        // Rejection: a member uniformly, kept with probability propensity / upper bound of the bin
+        auto& bin = bins[chosen];
+        auto bound = std::ldexp(1.0, static_cast<int>(chosen) + lowest_exponent);
+        std::uniform_int_distribution<size_t> pick{bin.start, bin.start + bin.size - 1};
+        std::uniform_real_distribution<double_t> uniform{0.0, bound};
+        while (true) {
+            auto candidate = pool[pick(random)];
+            if (uniform(random) < propensities[candidate]) {
+                return candidate;
+            }
+        }
+    }
+
+    size_t PropensityIndex::select(std::default_random_engine& random) const {
+        switch (engine) {
+            case SsaEngine::logarithmic_direct:
+                return select_tree(std::uniform_real_distribution<double_t>(0.0, sum)(random));
+            case SsaEngine::composition_rejection:
+                return select_binned(random);
+            default:
+                return select_linear(std::uniform_real_distribution<double_t>(0.0, sum)(random));
+        }
+    }
+}
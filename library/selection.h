@@ -0,0 +1,74 @@
+#ifndef SP_EXAM_PROJECT_SELECTION_H
+#define SP_EXAM_PROJECT_SELECTION_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace StochasticSimulation {
+
+    // How the exact engines pick the reaction that fires, all of them sample the same process
+    enum class SsaEngine {
+        direct,                // linear scan over the propensities, O(R) per event
+        logarithmic_direct,    // search in a Fenwick tree of the propensities, O(log R) per event
+        composition_rejection  // propensities binned by powers of two, O(1) expected per event
+    };
+
+    // Propensities of the reactions of a network with the structure needed to pick one in proportion
+    // to its propensity
+    class PropensityIndex {
+    private:
+        // Reactions whose propensity is in [2^(exponent - 1), 2^exponent), a segment of the pool
+        struct Bin {
+            size_t start{0};
+            size_t size{0};
+            double_t sum{0};
+        };
+
+        static constexpr int no_bin = INT32_MIN;
+        static constexpr int lowest_exponent = -1100;  // below the smallest subnormal
+
+        SsaEngine engine;
+        std::vector<double_t> propensities{};
+        double_t sum{0};
+        std::vector<double_t> tree{};                   // Fenwick tree, 1-based
+        size_t top_bit{0};                              // largest power of two not above the size
+        std::vector<Bin> bins{};                        // indexed by exponent - lowest_exponent
+        std::vector<uint64_t> occupied{};               // bit per bin, set while it has members
+        std::vector<size_t> pool{};                     // reactions with a positive propensity, segments in bin order
+        size_t pooled{0};
+        std::vector<int> bin_of{};                      // reaction -> its bin, no_bin when 0
+        std::vector<size_t> position{};                 // reaction -> its position in the pool
+
+        void place(size_t reaction, size_t at);
+        [[nodiscard]] size_t next_occupied(size_t from) const;
+        void tree_add(size_t reaction, double_t delta);
+        void bin_remove(size_t reaction);
+        void bin_insert(size_t reaction, double_t propensity);
+        size_t select_linear(double_t target) const;
+        size_t select_tree(double_t target) const;
+        size_t select_binned(std::default_random_engine& random) const;
+    public:
+        PropensityIndex(SsaEngine engine, size_t reactions);
+
+        void update(size_t reaction, double_t propensity);
+
+        // Recomputes the sums from the stored propensities, the running sums drift with rounding errors
+        void rebuild();
+
+        // Reaction picked with probability propensity / total, total must be positive
+        size_t select(std::default_random_engine& random) const;
+
+        [[nodiscard]] double_t total() const {
+            return sum;
+        }
+
+        [[nodiscard]] double_t operator[](size_t reaction) const {
+            return propensities[reaction];
+        }
+    };
+}
+
+#endif //SP_EXAM_PROJECT_SELECTION_H
@@ -0,0 +1,153 @@
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include "simulation.h"
+
+namespace StochasticSimulation {
+
+    namespace {
+        // Regularized incomplete beta function I_x(a, b) through its continued fraction (modified Lentz)
+        double_t incomplete_beta(double_t x, double_t a, double_t b) {
+            if (x <= 0 || x >= 1) {
+                return x <= 0 ? 0.0 : 1.0;
+            }
+            // The fraction converges quickly below (a + 1) / (a + b + 2), above it the symmetry is used
+            if (x > (a + 1) / (a + b + 2)) {
+                return 1 - incomplete_beta(1 - x, b, a);
+            }
+
+            constexpr auto tiny = 1e-300;
+            auto clamp = [](double_t value) { return std::abs(value) < tiny ? tiny : value; };
+            auto c = 1.0;
+            auto d = 1 / clamp(1 - (a + b) * x / (a + 1));
+            auto h = d;
+            for (int m = 1; m < 1000; ++m) {
+                auto even = m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m));
+                d = 1 / clamp(1 + even * d);
+                c = clamp(1 + even / c);
+                h *= d * c;
+
+                auto odd = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+                d = 1 / clamp(1 + odd * d);
+                c = clamp(1 + odd / c);
+                h *= d * c;
+                if (std::abs(d * c - 1) < 1e-15) {
+                    break;
+                }
+            }
+
+            auto front = std::exp(std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b) + a * std::log(x) + b * std::log1p(-x));
+            return front * h / a;
+        }
+
+        double_t student_cdf(double_t t, double_t degrees) {
+            auto tail = 0.5 * incomplete_beta(degrees / (degrees + t * t), degrees / 2, 0.5);
+            return t > 0 ? 1 - tail : tail;
+        }
+
+        // Quantile of Student's t distribution, found by bisection of the cdf like the normal quantile.
+        // Exact for any degrees of freedom, the interval is widened until it holds the quantile.
+        double_t student_quantile(double_t p, double_t degrees) {
+            double_t low{-1}, high{1};
+            while (student_cdf(low, degrees) > p) {
+                low *= 2;
+            }
+            while (student_cdf(high, degrees) < p) {
+                high *= 2;
+            }
+            for (int i = 0; i < 200 && high - low > 1e-12 * std::max(1.0, std::abs(high)); ++i) {
+                auto middle = (low + high) / 2;
+                if (student_cdf(middle, degrees) < p) {
+                    low = middle;
+                } else {
+                    high = middle;
+                }
+            }
+            return (low + high) / 2;
+        }
+
+        // Running mean and variance (Welford) with the stopping rule
+        class SequentialState {
+        private:
+            const SequentialOptions& options;
+            std::mutex mutex{};
+            size_t started{0};
+            size_t runs{0};
+            double_t mean{0};
+            double_t squares{0};
+            bool done{false};
+
+            [[nodiscard]] double_t variance() const {
+                return runs > 1 ? squares / static_cast<double_t>(runs - 1) : 0.0;
+            }
+
+            [[nodiscard]] double_t half_width() const {
+                if (runs < 2) {
+                    return std::numeric_limits<double_t>::infinity();
+                }
+                auto quantile = student_quantile(0.5 + options.confidence / 2, static_cast<double_t>(runs - 1));
+                return quantile * std::sqrt(variance() / static_cast<double_t>(runs));
+            }
+
+            [[nodiscard]] bool converged() const {
+                auto target = options.relative ? options.half_width * std::abs(mean) : options.half_width;
+                return runs >= options.min_runs && half_width() <= target;
+            }
+        public:
+            explicit SequentialState(const SequentialOptions& options): options(options) {}
+
+            // Claims the next run, false once the target is met or max_runs have been started
+            bool start() {
+                std::lock_guard lock{mutex};
+                if (done || started >= options.max_runs) {
+                    return false;
+                }
+                started++;
+                return true;
+            }
+
+            void add(double_t value) {
+                std::lock_guard lock{mutex};
+                runs++;
+                auto delta = value - mean;
+                mean += delta / static_cast<double_t>(runs);
+                squares += delta * (value - mean);
+                done = done || converged();
+            }
+
+            SequentialEstimate result() {
+                std::lock_guard lock{mutex};
+                return {mean, half_width(), variance(), runs, converged()};
+            }
+        };
+    }
+
+    SequentialEstimate Vessel::do_sequential_simulations(double_t end_time, const TrajectoryStatistic& statistic, const SequentialOptions& options) {
+        if (options.confidence <= 0 || options.confidence >= 1) {
+            throw std::invalid_argument("Confidence must be between 0 and 1");
+        }
+
+        SequentialState state{options};
+
+        // hardware_concurrency may be unknown and report 0
+        auto cores = std::max(1u, std::thread::hardware_concurrency());
+        size_t jobs = options.threads != 0 ? options.threads : std::max<size_t>(1, std::min<size_t>(options.max_runs, cores - 1));
+
+        auto lambda = [&vessel = *this, &end_time, &statistic, &state]() {
+            auto new_vessel = Vessel(vessel);
+            while (state.start()) {
+                state.add(statistic(*new_vessel.do_simulation(end_time)));
+            }
+        };
+
+        auto futures = std::vector<std::future<void>>{};
+        for (size_t i = 0; i < jobs; ++i) {
+            futures.push_back(std::async(std::launch::async, lambda));
+        }
+        for (auto& future: futures) {
+            future.get();
+        }
+
+        return state.result();
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef SP_EXAM_PROJECT_SEQUENTIAL_H
+#define SP_EXAM_PROJECT_SEQUENTIAL_H
+
+#include <cmath>
+#include <cstddef>
+#include <functional>
+
+namespace StochasticSimulation {
+
+    class SimulationTrajectory;
+
+    // Number computed from one run, such as the peak of a species or its amount at a given time
+    using TrajectoryStatistic = std::function<double_t(const SimulationTrajectory&)>;
+
+    // Runs are added until the confidence interval of the mean statistic is narrow enough
+    struct SequentialOptions {
+        double_t half_width{0};     // target half-width of the confidence interval
+        bool relative{false};       // half_width is a fraction of the absolute mean
+        double_t confidence{0.95};
+        size_t min_runs{10};        // the variance of fewer runs is too uncertain to stop on
+        size_t max_runs{10000};
+        size_t threads{0};          // 0 uses one thread per core but one
+    };
+
+    struct SequentialEstimate {
+        double_t mean;
+        double_t half_width;        // of the confidence interval around mean
+        double_t variance;          // sample variance of the statistic
+        size_t runs;
+        bool converged;             // false when max_runs was reached first
+    };
+}
+
+#endif //SP_EXAM_PROJECT_SEQUENTIAL_H
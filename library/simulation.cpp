@@ -5,6 +5,8 @@
 #include <iostream>
 #include <utility>
 #include "simulation.h"
+#include "analysis.h"
+#include "writer.h"
 
 namespace StochasticSimulation {
 
@@ -22,6 +24,84 @@ namespace StochasticSimulation {
         return s << "}";
     }
 
+    void Vessel::schedule(Intervention intervention) {
+        auto position = std::upper_bound(interventions.begin(), interventions.end(), intervention.time,
+                                         [](double_t time, const Intervention& other){ return time < other.time; });
+        interventions.insert(position, intervention);
+    }
+
+    void Vessel::schedule_rate(double_t time, size_t reaction, double_t rate) {
+        if (reaction >= reactions.size()) {
+            throw std::out_of_range("Reaction " + std::to_string(reaction) + " does not exist");
+        }
+        schedule({time, Intervention::Kind::rate, reaction, rate});
+    }
+
+    void Vessel::schedule_amount(double_t time, std::string_view reactant, double_t change) {
+        schedule({time, Intervention::Kind::amount, reactants.symbol(reactant).id, change});
+    }
+
+    void Vessel::schedule_enabled(double_t time, size_t reaction, bool enabled) {
+        if (reaction >= reactions.size()) {
+            throw std::out_of_range("Reaction " + std::to_string(reaction) + " does not exist");
+        }
+        schedule({time, enabled ? Intervention::Kind::enable : Intervention::Kind::disable, reaction});
+    }
+
+    // Walks the interventions of a vessel in time order during a run of the name based engines,
+    // a disabled reaction gets rate 0 so compute_delay never picks it
+    class RunSchedule {
+    private:
+        const std::vector<Intervention>& interventions;
+        size_t next{0};
+        std::vector<double_t> rates{};
+        std::vector<bool> enabled{};
+    public:
+        RunSchedule(const std::vector<Intervention>& interventions, const std::vector<Reaction>& reactions):
+            interventions(interventions),
+            enabled(reactions.size(), true)
+        {
+            for (auto& reaction: reactions) {
+                rates.push_back(reaction.rate);
+            }
+        }
+
+        [[nodiscard]] bool due(double_t time) const {
+            return next < interventions.size() && interventions[next].time <= time;
+        }
+
+        [[nodiscard]] double_t next_time() const {
+            return interventions[next].time;
+        }
+
+        // Applies every intervention scheduled at the next time
+        void apply(std::vector<Reaction>& reactions, SimulationState& state) {
+            auto time = next_time();
+            while (next < interventions.size() && interventions[next].time == time) {
+                auto& intervention = interventions[next++];
+                switch (intervention.kind) {
+                    case Intervention::Kind::rate:
+                        rates[intervention.target] = intervention.value;
+                        break;
+                    case Intervention::Kind::amount: {
+                        auto& amount = state.reactants[Symbol{intervention.target}].amount;
+                        amount = std::max(0.0, amount + intervention.value);
+                        break;
+                    }
+                    case Intervention::Kind::enable:
+                        enabled[intervention.target] = true;
+                        break;
+                    case Intervention::Kind::disable:
+                        enabled[intervention.target] = false;
+                        break;
+                }
+                if (intervention.kind != Intervention::Kind::amount) {
+                    reactions[intervention.target].rate = enabled[intervention.target] ? rates[intervention.target] : 0;
+                }
+            }
+        }
+    };
+
     // Requirement 2
     void Vessel::visualize_reactions(const std::string& filename) {
         std::stringstream str;
@@ -30,7 +110,7 @@ namespace StochasticSimulation {
         str << "digraph {" << std::endl;
 
         auto i = 0;
-        for (auto& reactant: reactants.getMap()) {
+        for (auto& reactant: reactants) {
             if (reactant.second.name != "__env__") {
                 node_map.put(reactant.second.name, "s" + std::to_string(i));
 
@@ -78,45 +158,86 @@ namespace StochasticSimulation {
 
     // Requirement 10 alternative simulation
     std::shared_ptr<SimulationTrajectory> Vessel::do_simulation2(double_t end_time, simulation_monitor &monitor) {
-        SimulationTrajectory trajectory{};
+        SimulationTrajectory trajectory{reactants};
         double_t t{0};
 
         auto thread_id = std::this_thread::get_id();
         auto epoch = std::chrono::system_clock::now().time_since_epoch().count();
         std::default_random_engine engine(epoch * (std::hash<std::thread::id>{}(thread_id)));
 
-        // Insert initial state
-        trajectory.insert(SimulationState{reactants, t});
+        // The state is updated in place and each step is appended as a row to the trajectory
+        SimulationState state{reactants, t};
+        trajectory.insert(state);
+
+        // Interventions change the rates of this run only
+        auto run_reactions = reactions;
+        RunSchedule schedule{interventions, run_reactions};
+        CompletionQueue pending{};
+
+        // Reactions that can never fire are left out of the delay computation
+        auto dead = find_dead_reactions(ReactionNetwork{*this});
+        for (size_t i = 0; i < run_reactions.size(); ++i) {
+            if (dead[i]) {
+                run_reactions[i].delay = -1;
+            }
+        }
 
         while (t <= end_time) {
-            for (Reaction& reaction: reactions) {
+            for (size_t i = 0; i < run_reactions.size(); ++i) {
                 // New: using new compute delay function
-                reaction.compute_delay2(trajectory.at(t), engine);
+                if (!dead[i]) {
+                    run_reactions[i].compute_delay2(state, engine);
+                }
             }
 
-            auto r = reactions.front();
+            size_t selected{0};
 
             // Select Reaction with min delay which is not -1
-            for (auto& reaction: reactions) {
+            for (size_t i = 1; i < run_reactions.size(); ++i) {
+                auto& reaction = run_reactions[i];
+                auto& current = run_reactions[selected];
                 if (reaction.delay == -1) {
                     continue;
-                } else if (reaction.delay < r.delay) {
-                    r = reaction;
-                } else if (r.delay == -1) {
-                    r = reaction;
+                } else if (reaction.delay < current.delay) {
+                    selected = i;
+                } else if (current.delay == -1) {
+                    selected = i;
                 }
             }
+            auto& r = run_reactions[selected];
+
+            auto horizon = r.delay == -1 ? end_time : std::min(t + r.delay, end_time);
+
+            // A delayed reaction completing before the next reaction and intervention releases its products
+            if (pending.next_time() <= horizon && !(schedule.due(horizon) && schedule.next_time() < pending.next_time())) {
+                auto completion = pending.pop();
+                t = completion.time;
+                state.time = t;
+                for (auto& reactant: run_reactions[completion.reaction].to) {
+                    state.reactants.get(reactant.name).amount += reactant.required;
+                }
+                trajectory.insert(state);
+                monitor.monitor(state);
+                continue;
+            }
+
+            // An intervention happening before the next reaction goes first, the delays are sampled again after it
+            if (schedule.due(horizon)) {
+                t = schedule.next_time();
+                state.time = t;
+                schedule.apply(run_reactions, state);
+                trajectory.insert(state);
+                monitor.monitor(state);
+                continue;
+            }
 
             // Stop if we have no reactions to do, thus r.delay == -1
             if (r.delay == -1) {
                 break;
             }
 
-            auto& last_state = trajectory.at(t);
-
             t += r.delay;
-
-            SimulationState state{last_state.reactants, t};
+            state.time = t;
 
             if (
                     std::all_of(r.from.begin(), r.from.end(), [&state](const Reactant& e){return state.reactants.get(e.name).amount >= e.required;}) &&
@@ -128,14 +249,18 @@ namespace StochasticSimulation {
                 for (auto& reactant: r.from) {
                     state.reactants.get(reactant.name).amount -= reactant.required;
                 }
-                for (auto& reactant: r.to) {
-                    state.reactants.get(reactant.name).amount += reactant.required;
+                if (r.latency.has_value()) {
+                    pending.push(t + r.latency->sample(engine), selected);
+                } else {
+                    for (auto& reactant: r.to) {
+                        state.reactants.get(reactant.name).amount += reactant.required;
+                    }
                 }
             }
 
-            trajectory.insert(std::move(state));
+            trajectory.insert(state);
 
-            monitor.monitor(trajectory.at(t));
+            monitor.monitor(state);
         }
 
         return std::make_shared<SimulationTrajectory>(std::move(trajectory));
@@ -143,99 +268,121 @@ namespace StochasticSimulation {
 
     // Requirement 4 simulation
     std::shared_ptr<SimulationTrajectory> Vessel::do_simulation(double_t end_time, simulation_monitor &monitor) {
-        SimulationTrajectory trajectory{};
-        double_t t{0};
-
-        auto thread_id = std::this_thread::get_id();
-        auto epoch = std::chrono::system_clock::now().time_since_epoch().count();
-        std::default_random_engine engine(epoch * (std::hash<std::thread::id>{}(thread_id)));
-
-        // Insert initial state
-        trajectory.insert(SimulationState{reactants, t});
-
-        while (t <= end_time) {
-            for (Reaction& reaction: reactions) {
-                reaction.compute_delay(trajectory.at(t), engine);
-            }
-
-            auto r = reactions.front();
-
-            // Select Reaction with min delay which is not -1
-            for (auto& reaction: reactions) {
-                if (reaction.delay == -1) {
-                    continue;
-                } else if (reaction.delay < r.delay) {
-                    r = reaction;
-                } else if (r.delay == -1 && reaction.delay != -1) {
-                    r = reaction;
-                }
-            }
-
-            // Stop if we have no reactions to do, thus r.delay == -1
-            if (r.delay == -1) {
-                break;
-            }
-
-            auto& last_state = trajectory.at(t);
-
-            t += r.delay;
+        return do_simulation(end_time, monitor, std::stop_token{});
+    }
 
-            SimulationState state{last_state.reactants, t};
+    std::shared_ptr<SimulationTrajectory> Vessel::do_simulation(double_t end_time, simulation_monitor &monitor, std::stop_token stop_token) {
+        return do_stepper_simulation(end_time, SsaEngine::direct, monitor, stop_token);
+    }
 
-            if (
-                    std::all_of(r.from.begin(), r.from.end(), [&state](const Reactant& e){return state.reactants.get(e.name).amount >= e.required;}) &&
-                    (
-                            !r.catalysts.has_value() ||
-                            std::all_of(r.catalysts.value().begin(), r.catalysts.value().end(), [&state](const Reactant& e){return state.reactants.get(e.name).amount >= e.required;})
-                    )
-                    ) {
-                for (auto& reactant: r.from) {
-                    state.reactants.get(reactant.name).amount -= reactant.required;
-                }
-                for (auto& reactant: r.to) {
-                    state.reactants.get(reactant.name).amount += reactant.required;
-                }
+    // Publishes the events and simulated time of a run to the shared counters in batches
+    class progress_simulation_monitor: public simulation_monitor {
+    private:
+        EnsembleProgress& progress;
+        size_t events{0};
+        double_t last_time{0};
+        double_t published_time{0};
+    public:
+        explicit progress_simulation_monitor(EnsembleProgress& progress): progress(progress) {}
+
+        void monitor(SimulationState& state) override {
+            last_time = state.time;
+            if (++events == 1024) {
+                publish();
             }
+        }
 
-            trajectory.insert(std::move(state));
-
-            monitor.monitor(trajectory.at(t));
+        void publish() {
+            progress.events += events;
+            progress.simulated_time += last_time - published_time;
+            events = 0;
+            published_time = last_time;
         }
 
-        return std::make_shared<SimulationTrajectory>(std::move(trajectory));
-    }
+        void next_run() {
+            publish();
+            last_time = 0;
+            published_time = 0;
+        }
+    };
 
     // Requirement 8 multiple at same time
     std::vector<std::shared_ptr<SimulationTrajectory>>
-    Vessel::do_multiple_simulations(double_t end_time, size_t simulations_to_run) {
+    Vessel::do_multiple_simulations(double_t end_time, size_t simulations_to_run, const EnsembleControl& control) {
         std::vector<std::shared_ptr<SimulationTrajectory>> result{};
         result.reserve(simulations_to_run);
 
-        auto cores = std::thread::hardware_concurrency();
-        int jobs = std::min(simulations_to_run, (cores - 1));
+        // Pinned workers are counted from the cpus the plan may use, so none of them share a cpu. One core
+        // is left for the worker of the remaining runs.
+        PlacementPlan plan{control.placement};
+        auto cores = control.placement == ThreadPlacement::unpinned
+                ? std::max<size_t>(1, std::thread::hardware_concurrency())
+                : plan.cpu_count();
+        size_t jobs = std::max<size_t>(1, std::min<size_t>(simulations_to_run, cores - 1));
         auto simulations_per_job = simulations_to_run / jobs;
 
         auto futures = std::vector<std::future<std::vector<std::shared_ptr<SimulationTrajectory>>>>{};
 
-        auto lambda = [&vessel = *this, &end_time](size_t to_run){
+        // Stopped by the caller or when the time budget runs out
+        std::stop_source stop_source{};
+        std::stop_callback forward_stop{control.stop_token, [&stop_source](){ stop_source.request_stop(); }};
+
+        EnsembleProgress local_progress{};
+        auto& progress = control.progress != nullptr ? *control.progress : local_progress;
+
+        auto report = plan.report();
+        report.workers.resize(jobs + (simulations_to_run % jobs != 0 ? 1 : 0));
+
+        auto lambda = [&vessel = *this, &end_time, &control, &progress, &plan, &report, simulations_per_job, stop_token = stop_source.get_token()](size_t worker, size_t to_run){
+            // Pinned before anything is allocated, the first touch places the pages on the node of the worker
+            auto& placement = report.workers[worker];
+            placement = plan.apply(worker);
+
             auto simulations = std::vector<std::shared_ptr<SimulationTrajectory>>{};
             simulations.reserve(to_run);
 
             auto new_vessel = Vessel(vessel);
+            progress_simulation_monitor monitor{progress};
 
-            for (int i = 0; i < to_run; ++i) {
-                simulations.push_back(new_vessel.do_simulation(end_time));
+            for (int i = 0; i < to_run && !stop_token.stop_requested(); ++i) {
+                auto simulation = new_vessel.do_simulation(end_time, monitor, stop_token);
+                monitor.next_run();
+
+                // A run cut short by a stop is not part of the result
+                if (stop_token.stop_requested()) {
+                    break;
+                }
+
+                if (control.writer != nullptr) {
+                    control.writer->submit(worker * simulations_per_job + i, simulation);
+                }
+                simulations.push_back(std::move(simulation));
+                placement.runs++;
+                progress.runs_done++;
+                if (control.on_run_finished) {
+                    control.on_run_finished(progress);
+                }
             }
 
             return simulations;
         };
 
         for (int i = 0; i < jobs; ++i) {
-            futures.push_back(std::async(std::launch::async, lambda, simulations_per_job));
+            futures.push_back(std::async(std::launch::async, lambda, i, simulations_per_job));
         }
         auto missing_simulations = simulations_to_run - (simulations_per_job * jobs);
         if (missing_simulations != 0) {
-            futures.push_back(std::async(std::launch::async, lambda, missing_simulations));
+            futures.push_back(std::async(std::launch::async, lambda, jobs, missing_simulations));
+        }
+
+        if (control.time_budget.has_value()) {
+            auto deadline = std::chrono::steady_clock::now() + control.time_budget.value();
+            for (auto& future: futures) {
+                if (future.wait_until(deadline) == std::future_status::timeout) {
+                    stop_source.request_stop();
+                    break;
+                }
+            }
         }
 
         for (auto& future: futures) {
@@ -245,29 +392,99 @@ namespace StochasticSimulation {
             }
         }
 
+        if (control.placement_report != nullptr) {
+            *control.placement_report = std::move(report);
+        }
         return result;
     }
 
-    // Private function for calculation interpolated value
-    double_t SimulationTrajectory::compute_interpolated_value(const std::string& key, SimulationState& s0, SimulationState& s1, double_t x) {
-        return
-            s0.reactants.get(key).amount
-            + ((
-                   ( (double_t) s1.reactants.get(key).amount - (double_t) s0.reactants.get(key).amount) /
-                   ( s1.time - s0.time )
-               ) * (x - s0.time));
+    TrajectoryPoint TrajectoryView::iterator::operator*() const {
+        return (*trajectory)[row];
     }
 
-    // Requirement 9 compute mean trajectory
-    SimulationTrajectory SimulationTrajectory::compute_mean_trajectory(std::vector<std::shared_ptr<SimulationTrajectory>>& trajectories) {
-        auto average_delay = trajectories.front()->get_max_time() / trajectories.front()->size();
+    TrajectoryPoint TrajectoryView::operator[](size_t i) const {
+        return (*trajectory)[first + i];
+    }
 
-        // Get a list of all keys
-        std::vector<std::string> reactant_keys{};
-        for (auto& reactant: trajectories.front()->begin()->second.reactants) {
-            reactant_keys.push_back(reactant.second.name);
+    void SimulationTrajectory::insert(const SimulationState& state) {
+        if (layout.empty()) {
+            layout = state.reactants;
         }
 
+        auto position = times.empty() || state.time >= times.back()
+                ? times.size()
+                : static_cast<size_t>(std::upper_bound(times.begin(), times.end(), state.time) - times.begin());
+
+        times.insert(times.begin() + position, state.time);
+        auto destination = amounts.insert(amounts.begin() + position * width(), width(), 0.0);
+        for (auto& reactant: state.reactants) {
+            *destination++ = reactant.second.amount;
+        }
+    }
+
+    void SimulationTrajectory::insert(double_t time, std::span<const double_t> row) {
+        if (times.empty() || time >= times.back()) {
+            times.push_back(time);
+            amounts.insert(amounts.end(), row.begin(), row.end());
+            return;
+        }
+
+        auto position = static_cast<size_t>(std::upper_bound(times.begin(), times.end(), time) - times.begin());
+        times.insert(times.begin() + position, time);
+        amounts.insert(amounts.begin() + position * width(), row.begin(), row.end());
+    }
+
+    // Index of the last row at or before time, or the first row if time is before all of them
+    size_t SimulationTrajectory::row_at(double_t time) const {
+        auto after = std::upper_bound(times.begin(), times.end(), time);
+        if (after == times.begin()) {
+            return 0;
+        }
+        return static_cast<size_t>(after - times.begin()) - 1;
+    }
+
+    // Rows can share a time, e.g. the initial state and an intervention at 0, the later row holds then
+    double_t SimulationTrajectory::interpolate(double_t t0, double_t v0, double_t t1, double_t v1, double_t x) {
+        if (t1 == t0) {
+            return v1;
+        }
+        return v0 + (((v1 - v0) / (t1 - t0)) * (x - t0));
+    }
+
+    double_t SimulationTrajectory::value_at(double_t time, Symbol symbol, Interpolation interpolation) const {
+        auto i = row_at(time);
+        auto value = row(i)[symbol.id];
+
+        if (interpolation == Interpolation::step || i + 1 >= size() || time <= times[i]) {
+            return value;
+        }
+        return interpolate(times[i], value, times[i + 1], row(i + 1)[symbol.id], time);
+    }
+
+    double_t SimulationTrajectory::value_at(double_t time, std::string_view key, Interpolation interpolation) const {
+        return value_at(time, layout.symbol(key), interpolation);
+    }
+
+    SimulationState SimulationTrajectory::state_at(double_t time, Interpolation interpolation) const {
+        SimulationState state{layout, time};
+        for (size_t i = 0; i < width(); ++i) {
+            state.reactants[Symbol{i}].amount = value_at(time, Symbol{i}, interpolation);
+        }
+        return state;
+    }
+
+    TrajectoryView SimulationTrajectory::window(double_t from, double_t to) const {
+        auto first = std::lower_bound(times.begin(), times.end(), from);
+        auto last = std::upper_bound(first, times.end(), to);
+        return {this, static_cast<size_t>(first - times.begin()), static_cast<size_t>(last - times.begin())};
+    }
+
+    // Requirement 9 compute mean trajectory
+    SimulationTrajectory SimulationTrajectory::compute_mean_trajectory(std::vector<std::shared_ptr<SimulationTrajectory>>& trajectories) {
+        auto& first = *trajectories.front();
+        auto average_delay = first.get_max_time() / first.size();
+        auto width = first.width();
+
         // Find upper bound for mean trajectory
         double_t upper_bound{-1.0};
         for (auto& trajectory: trajectories) {
@@ -276,80 +493,76 @@ namespace StochasticSimulation {
             }
         }
 
-        SimulationTrajectory mean_trajectory{};
+        size_t points{0};
+        while ((points * average_delay + average_delay) <= upper_bound) {
+            points++;
+        }
 
+        // Every trajectory is walked once front to back, interpolating onto the shared grid
+        std::vector<double_t> sums(points * width, 0.0);
         for (auto& trajectory: trajectories) {
-            auto iterator = trajectory->begin();
-            SimulationState& s0 = iterator->second;
-            iterator++;
-            SimulationState& s1 = iterator->second;
-
-            double_t t{0};
-
-            while((t + average_delay) <= upper_bound) {
-                if (t >= s0.time) {
-                    if (t <= s1.time) {
-                        if (!mean_trajectory.contains(t)) {
-                            mean_trajectory.insert((SimulationState{{}, t}));
-                        }
-
-                        for (auto& key: reactant_keys) {
-                            auto interpolated_value = SimulationTrajectory::compute_interpolated_value(key, s0, s1, t);
-
-                            auto& table = mean_trajectory.at(t).reactants;
-
-                            if (!table.contains(key)) {
-                                Reactant reactant{key, 0.0};
-                                table.put(key, reactant);
-                            }
-
-                            table.get(key).amount += interpolated_value;
-                        }
-
-                        t += average_delay;
-                    } else {
-                        s0 = s1;
-                        iterator++;
-
-                        if (iterator != trajectory->end()) {
-                            s1 = iterator->second;
-                        } else {
-                            break;
-                        }
+            size_t i{0};
+            for (size_t point = 0; point < points; ++point) {
+                auto t = point * average_delay;
+                while (i + 1 < trajectory->size() && trajectory->times[i + 1] < t) {
+                    i++;
+                }
+
+                auto s0 = trajectory->row(i);
+                auto sum = sums.begin() + point * width;
+                if (i + 1 < trajectory->size()) {
+                    auto s1 = trajectory->row(i + 1);
+                    for (size_t j = 0; j < width; ++j) {
+                        sum[j] += interpolate(trajectory->times[i], s0[j], trajectory->times[i + 1], s1[j], t);
+                    }
+                } else {
+                    for (size_t j = 0; j < width; ++j) {
+                        sum[j] += s0[j];
                     }
                 }
             }
         }
 
-        for (double_t i = 0; (i + average_delay) <= upper_bound; i += average_delay) {
-            for (auto& key: reactant_keys) {
-                mean_trajectory.at(i).reactants.get(key).amount /= trajectories.size();
-            }
+        SimulationTrajectory mean_trajectory{first.layout};
+        mean_trajectory.reserve(points);
+        for (auto& sum: sums) {
+            sum /= trajectories.size();
+        }
+        for (size_t point = 0; point < points; ++point) {
+            mean_trajectory.insert(point * average_delay, {sums.data() + point * width, width});
         }
 
-        return std::move(mean_trajectory);
+        return mean_trajectory;
     }
 
     // Requirement 6 output to csv which can then be turned into a graph via python script
-    void SimulationTrajectory::write_csv(const std::string &path) {
+    void SimulationTrajectory::write_csv(const std::string &path, const DownsamplingOptions& downsampling) const {
         std::ofstream csv_file;
         csv_file.open(path);
 
-        auto reactants = at(0).reactants;
-
-        for (auto& reactant : reactants) {
+        for (auto& reactant : layout) {
             csv_file << reactant.second.name << ",";
         }
         csv_file << "time" << std::endl;
 
-        for (auto& state : *this) {
-            for (auto& reactant: reactants) {
-                csv_file << state.second.reactants.get(reactant.second.name).amount << ",";
+        auto write_row = [this, &csv_file](size_t row) {
+            auto point = (*this)[row];
+            for (auto amount: point.amounts) {
+                csv_file << amount << ",";
+            }
+            csv_file << point.time << "\n";
+        };
+
+        if (downsampling.method == Downsampling::none) {
+            for (size_t row = 0; row < size(); ++row) {
+                write_row(row);
+            }
+        } else {
+            for (auto row: downsampled_rows(downsampling)) {
+                write_row(row);
             }
-            csv_file << state.second.time << std::endl;
         }
 
         csv_file.close();
     }
 }
-
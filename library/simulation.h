@@ -20,67 +20,247 @@
 #include <chrono>
 #include <thread>
 #include <future>
+#include <stop_token>
 #include <ranges>
+#include <span>
 #include "SymbolTable.h"
 #include "simulation_monitor.h"
 #include "data.h"
+#include "ode.h"
+#include "hybrid.h"
+#include "slow_scale.h"
+#include "generator.h"
+#include "ensemble.h"
+#include "process_ensemble.h"
+#include "intervention.h"
+#include "sequential.h"
+#include "selection.h"
+#include "downsample.h"
 
 namespace StochasticSimulation {
 
-    using map_type = std::map<double_t, SimulationState>;
-    class SimulationTrajectory: public map_type {
+    enum class Interpolation {
+        step,   // value of the last state at or before the time, exact for stochastic trajectories
+        linear  // straight line between the surrounding states
+    };
+
+    // A single row of a trajectory, amounts are indexed by symbol id
+    struct TrajectoryPoint {
+        double_t time;
+        std::span<const double_t> amounts;
+
+        double_t operator[](Symbol symbol) const {
+            return amounts[symbol.id];
+        }
+    };
+
+    class SimulationTrajectory;
+
+    // Contiguous range of rows in a trajectory, such as a time window
+    class TrajectoryView {
     private:
-        double_t largest_time{-1};
-        static double_t compute_interpolated_value(
-                const std::string& key,
-                SimulationState& s0,
-                SimulationState& s1,
-                double_t x);
+        const SimulationTrajectory* trajectory;
+        size_t first;
+        size_t last;
     public:
-        using map_type::map;
+        class iterator {
+        private:
+            const SimulationTrajectory* trajectory{nullptr};
+            size_t row{0};
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = TrajectoryPoint;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = TrajectoryPoint;
+
+            iterator() = default;
+            iterator(const SimulationTrajectory* trajectory, size_t row): trajectory(trajectory), row(row) {}
+
+            TrajectoryPoint operator*() const;
+
+            iterator& operator++() {
+                row++;
+                return *this;
+            }
 
-        SimulationTrajectory(const SimulationTrajectory& val): map_type(val) {
-            largest_time = val.largest_time;
-        }
+            iterator operator++(int) {
+                auto copy = *this;
+                row++;
+                return copy;
+            }
 
-        SimulationTrajectory(SimulationTrajectory&& rval): map_type(std::move(rval)) {
-            largest_time = std::move(rval.largest_time);
+            bool operator==(const iterator& other) const {
+                return row == other.row && trajectory == other.trajectory;
+            }
         };
 
-        SimulationTrajectory& operator=(const SimulationTrajectory & val) {
-            map_type::operator=(val);
-            largest_time = val.largest_time;
-        };
+        TrajectoryView(const SimulationTrajectory* trajectory, size_t first, size_t last):
+            trajectory(trajectory),
+            first(first),
+            last(last)
+        {}
 
-        SimulationTrajectory& operator=(SimulationTrajectory&& rval) {
-            map_type::operator=(std::move(rval));
-            largest_time = std::move(rval.largest_time);
-        };
+        [[nodiscard]] iterator begin() const {
+            return {trajectory, first};
+        }
+
+        [[nodiscard]] iterator end() const {
+            return {trajectory, last};
+        }
+
+        [[nodiscard]] size_t size() const {
+            return last - first;
+        }
+
+        [[nodiscard]] bool empty() const {
+            return first == last;
+        }
+
+        TrajectoryPoint operator[](size_t i) const;
+    };
+
+    // Sorted vector of times and a row-major matrix with one row of amounts per time,
+    // columns follow the symbol ids of the reactant table the trajectory was started from
+    class SimulationTrajectory {
+    private:
+        SymbolTable<Reactant> layout{};
+        std::vector<double_t> times{};
+        std::vector<double_t> amounts{};
+
+        [[nodiscard]] size_t row_at(double_t time) const;
+        static double_t interpolate(double_t t0, double_t v0, double_t t1, double_t v1, double_t x);
+    public:
+        SimulationTrajectory() = default;
+
+        explicit SimulationTrajectory(SymbolTable<Reactant> layout): layout(std::move(layout)) {}
+
+        // Times must be sorted, amounts holds one row of layout.size() amounts per time
+        SimulationTrajectory(SymbolTable<Reactant> layout, std::vector<double_t> times, std::vector<double_t> amounts):
+            layout(std::move(layout)),
+            times(std::move(times)),
+            amounts(std::move(amounts))
+        {}
+
+        SimulationTrajectory(const SimulationTrajectory& val) = default;
+        SimulationTrajectory(SimulationTrajectory&& rval) noexcept = default;
+
+        SimulationTrajectory& operator=(const SimulationTrajectory& val) = default;
+        SimulationTrajectory& operator=(SimulationTrajectory&& rval) noexcept = default;
 
         // Requirement 9 compute mean
         static SimulationTrajectory compute_mean_trajectory(std::vector<std::shared_ptr<SimulationTrajectory>>& trajectories);
 
-        void insert(SimulationState state) {
-            if (state.time > largest_time) {
-                largest_time = state.time;
-            }
+        void insert(const SimulationState& state);
+
+        // Rows are expected in time order, older times are inserted at their sorted position
+        void insert(double_t time, std::span<const double_t> row);
+
+        void reserve(size_t rows) {
+            times.reserve(rows);
+            amounts.reserve(rows * width());
+        }
+
+        [[nodiscard]] size_t size() const {
+            return times.size();
+        }
 
-            map_type::insert({state.time, std::move(state)});
+        [[nodiscard]] bool empty() const {
+            return times.empty();
+        }
+
+        // Number of columns (reactants) in a row
+        [[nodiscard]] size_t width() const {
+            return layout.size();
+        }
+
+        [[nodiscard]] const SymbolTable<Reactant>& species() const {
+            return layout;
+        }
+
+        [[nodiscard]] std::span<const double_t> get_times() const {
+            return times;
+        }
+
+        [[nodiscard]] double_t time(size_t row) const {
+            return times[row];
+        }
+
+        [[nodiscard]] std::span<const double_t> row(size_t row) const {
+            return {amounts.data() + row * width(), width()};
+        }
+
+        TrajectoryPoint operator[](size_t row) const {
+            return {times[row], this->row(row)};
+        }
+
+        // Value of a reactant at any time in O(log n), clamped to the first and last state
+        [[nodiscard]] double_t value_at(double_t time, Symbol symbol, Interpolation interpolation = Interpolation::step) const;
+        [[nodiscard]] double_t value_at(double_t time, std::string_view key, Interpolation interpolation = Interpolation::step) const;
+
+        [[nodiscard]] SimulationState state_at(double_t time, Interpolation interpolation = Interpolation::step) const;
+
+        // Rows with from <= time <= to
+        [[nodiscard]] TrajectoryView window(double_t from, double_t to) const;
+
+        [[nodiscard]] TrajectoryView::iterator begin() const {
+            return {this, 0};
+        }
+
+        [[nodiscard]] TrajectoryView::iterator end() const {
+            return {this, size()};
         }
 
         // Requirement 6 output trajectory
-        void write_csv(const std::string& path);
+        void write_csv(const std::string& path, const DownsamplingOptions& downsampling = {}) const;
+
+        // Sorted indices of the rows kept by the downsampling, the first and last row are always kept
+        [[nodiscard]] std::vector<size_t> downsampled_rows(const DownsamplingOptions& downsampling) const;
 
-        double_t get_max_time() {
-            return largest_time;
+        [[nodiscard]] SimulationTrajectory downsample(const DownsamplingOptions& downsampling) const;
+
+        [[nodiscard]] double_t get_max_time() const {
+            return times.empty() ? -1 : times.back();
         }
     };
 
+    // Mean and variance of every reactant on an even time grid, gathered over an ensemble of runs
+    struct EnsembleStatistics {
+        SymbolTable<Reactant> species{};
+        std::vector<double_t> times{};
+        std::vector<double_t> mean{};      // row-major, one row per time
+        std::vector<double_t> variance{};  // row-major, one row per time
+        size_t runs{0};
+        size_t requested{0};               // more than runs when runs were lost to crashed workers
+
+        [[nodiscard]] bool complete() const {
+            return runs == requested;
+        }
+
+        [[nodiscard]] SimulationTrajectory mean_trajectory() const;
+    };
+
     // Requirement 1 operators for DSEL
     class Vessel {
     private:
         std::vector<Reaction> reactions{};
         SymbolTable<Reactant> reactants;
+        std::vector<Intervention> interventions{};
+        // Rows and delayed reactions in flight of the longest run so far. The buffers of the next run are
+        // reserved from them, so runs of a similar length do not allocate while stepping. Const runs
+        // update them as well, possibly from several threads.
+        mutable std::atomic<size_t> expected_rows{0};
+        mutable std::atomic<size_t> expected_in_flight{0};
+
+        void schedule(Intervention intervention);
+
+        // Sizes with a quarter more room than the longest run so far
+        [[nodiscard]] size_t reserved_rows() const;
+        [[nodiscard]] size_t reserved_in_flight() const;
+        void record_run(size_t rows, size_t in_flight = 0) const;
+
+        // Runs on the compiled network, the stepping loop does not allocate once the buffers are warm
+        std::shared_ptr<SimulationTrajectory> do_stepper_simulation(double_t end_time, SsaEngine selection, simulation_monitor& monitor, std::stop_token stop_token);
     public:
 
         Vessel() = default;
@@ -88,11 +268,17 @@ namespace StochasticSimulation {
         Vessel(const Vessel &val) {
             reactions = val.reactions;
             reactants = val.reactants;
+            interventions = val.interventions;
+            expected_rows = val.expected_rows.load();
+            expected_in_flight = val.expected_in_flight.load();
         }
 
         Vessel (Vessel&& rval) {
             reactions = std::move(rval.reactions);
             reactants = std::move(rval.reactants);
+            interventions = std::move(rval.interventions);
+            expected_rows = rval.expected_rows.load();
+            expected_in_flight = rval.expected_in_flight.load();
         };
 
         Reactant& operator()(std::string name, size_t initial_amount) {
@@ -131,6 +317,52 @@ namespace StochasticSimulation {
             return reaction;
         }
 
+        // Delayed reactions, the products appear after the given latency
+        Reaction operator()(Reaction&& reaction, double_t rate, ReactionDelay latency) {
+            reaction.rate = rate;
+            reaction.latency = latency;
+
+            reactions.push_back(reaction);
+
+            return reaction;
+        }
+
+        Reaction operator()(Reaction&& reaction, Reactant catalyst, double_t rate, ReactionDelay latency) {
+            reaction.rate = rate;
+            reaction.catalysts = {catalyst};
+            reaction.latency = latency;
+
+            reactions.push_back(reaction);
+
+            return reaction;
+        }
+
+        // Bulk building for generated and loaded networks, the reaction is moved in instead of copied
+        void add_reaction(Reaction&& reaction) {
+            reactions.push_back(std::move(reaction));
+        }
+
+        void reserve_reactions(size_t count) {
+            reactions.reserve(count);
+        }
+
+        [[nodiscard]] const std::vector<Reaction>& get_reactions() const {
+            return reactions;
+        }
+
+        [[nodiscard]] const SymbolTable<Reactant>& get_reactants() const {
+            return reactants;
+        }
+
+        // Sorted by time, interventions at the same time keep the order they were scheduled in
+        [[nodiscard]] const std::vector<Intervention>& get_interventions() const {
+            return interventions;
+        }
+
+        // Timed changes applied by every engine while it runs, reactions are numbered in the order they were added
+        void schedule_rate(double_t time, size_t reaction, double_t rate);
+        void schedule_amount(double_t time, std::string_view reactant, double_t change);
+        void schedule_enabled(double_t time, size_t reaction, bool enabled);
 
         Reactant& environment() {
             if (reactants.contains("__env__")) {
@@ -153,8 +385,46 @@ namespace StochasticSimulation {
         // Requirement 4 simulation
         std::shared_ptr<SimulationTrajectory> do_simulation(double_t end_time, simulation_monitor& monitor = EMPTY_SIMULATION_MONITOR);
 
+        // Simulation on the compiled network with the given way of picking reactions, the logarithmic and
+        // composition-rejection engines are for networks with thousands of reactions
+        std::shared_ptr<SimulationTrajectory> do_simulation(double_t end_time, SsaEngine selection, simulation_monitor& monitor = EMPTY_SIMULATION_MONITOR);
+
+        // Stops early, returning the trajectory so far, once a stop is requested
+        std::shared_ptr<SimulationTrajectory> do_simulation(double_t end_time, simulation_monitor& monitor, std::stop_token stop_token);
+
+        // Deterministic solution of the mass-action reaction rate equations
+        std::shared_ptr<SimulationTrajectory> do_ode_simulation(double_t end_time, const OdeOptions& options = {}, simulation_monitor& monitor = EMPTY_SIMULATION_MONITOR);
+
+        // Continuous treatment of fast reactions on populous species, exact simulation of the rest
+        std::shared_ptr<SimulationTrajectory> do_hybrid_simulation(double_t end_time, const HybridOptions& options = {}, simulation_monitor& monitor = EMPTY_SIMULATION_MONITOR);
+
+        // Partial equilibrium treatment of fast reversible reaction pairs, only slow reactions are simulated
+        std::shared_ptr<SimulationTrajectory> do_slow_scale_simulation(double_t end_time, const SlowScaleOptions& options = {}, simulation_monitor& monitor = EMPTY_SIMULATION_MONITOR);
+
+        // Next reaction method where every reaction draws from its own random stream derived from seed, so
+        // vessels with the same reactions simulated with the same seed share their random numbers. The
+        // antithetic run uses 1 - u for every uniform u the plain run uses.
+        std::shared_ptr<SimulationTrajectory> do_next_reaction_simulation(double_t end_time, uint64_t seed, bool antithetic = false, simulation_monitor& monitor = EMPTY_SIMULATION_MONITOR) const;
+
+        // Lazily simulated run, every pull computes one more event. The amounts of a yielded point
+        // are only valid until the next pull. The vessel is compiled when called and can be dropped.
+        [[nodiscard]] Generator<TrajectoryPoint> simulate(double_t end_time, SsaEngine selection = SsaEngine::direct) const;
+        [[nodiscard]] Generator<TrajectoryPoint> simulate(double_t end_time, std::default_random_engine engine, SsaEngine selection = SsaEngine::direct) const;
+
         // Requirement 8 parallelization
-        std::vector<std::shared_ptr<SimulationTrajectory>> do_multiple_simulations(double_t end_time, size_t simulations_to_run);
+        // When stopped or out of time only the runs that were completed are returned
+        std::vector<std::shared_ptr<SimulationTrajectory>> do_multiple_simulations(double_t end_time, size_t simulations_to_run, const EnsembleControl& control = {});
+
+        // Keeps adding runs until the confidence interval of the mean statistic has the wanted half-width
+        // or max_runs is reached. Runs already started when the target is met are included.
+        SequentialEstimate do_sequential_simulations(double_t end_time, const TrajectoryStatistic& statistic, const SequentialOptions& options);
+
+        // Ensemble split over forked worker processes which aggregate into a shared memory segment,
+        // runs of a worker that crashed are left out and the result is not complete(). Only available
+        // on POSIX systems. The workers are forked from the calling thread and keep allocating, so no
+        // other thread of the process may be running: a lock such as the allocator's held by another
+        // thread at the fork would never be released in the worker.
+        EnsembleStatistics do_multiple_process_simulations(double_t end_time, size_t simulations_to_run, const ProcessEnsembleOptions& options = {}) const;
 
         // Requirement 2 pretty print
         friend std::ostream& operator<<(std::ostream& s, const Vessel& vessel);
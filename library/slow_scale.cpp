@@ -0,0 +1,343 @@
+#include <limits>
+#include <stdexcept>
+#include "network.h"
+
+namespace StochasticSimulation {
+
+    namespace {
+        struct FastPair {
+            size_t forward;
+            size_t backward;
+        };
+
+        // Fast pairs sharing species, together with the stationary distribution of their states.
+        // States are stored flat, one row of amounts of the subsystem's species per state.
+        struct FastSubsystem {
+            std::vector<FastPair> pairs{};
+            std::vector<size_t> species{};
+            std::vector<double_t> states{};
+            std::vector<double_t> probabilities{};
+            bool dirty{true};
+
+            [[nodiscard]] size_t size() const {
+                return probabilities.size();
+            }
+
+            [[nodiscard]] std::span<const double_t> state(size_t i) const {
+                return {states.data() + i * species.size(), species.size()};
+            }
+        };
+
+        std::vector<SpeciesAmount> sorted_inputs(const CompiledReaction& reaction) {
+            auto inputs = reaction.inputs;
+            std::sort(inputs.begin(), inputs.end(), [](auto& a, auto& b){ return a.species < b.species; });
+            return inputs;
+        }
+
+        std::vector<SpeciesAmount> sorted_products(const CompiledReaction& reaction) {
+            auto products = reaction.inputs;
+            for (auto& change: reaction.changes) {
+                auto it = std::find_if(products.begin(), products.end(), [&change](auto& e){ return e.species == change.species; });
+                if (it == products.end()) {
+                    products.push_back(change);
+                } else {
+                    it->amount += change.amount;
+                }
+            }
+            std::erase_if(products, [](auto& e){ return e.amount == 0; });
+            std::sort(products.begin(), products.end(), [](auto& a, auto& b){ return a.species < b.species; });
+            return products;
+        }
+
+        bool same_amounts(const std::vector<SpeciesAmount>& a, const std::vector<SpeciesAmount>& b) {
+            return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](auto& x, auto& y){ return x.species == y.species && x.amount == y.amount; });
+        }
+
+        // The reactants of one reaction are the products of the other and the other way around,
+        // a pair that merely cancels out in net change (production and decay) does not count
+        bool reverses(const CompiledReaction& a, const CompiledReaction& b) {
+            return !a.changes.empty() && a.catalysts.empty() && b.catalysts.empty() &&
+                same_amounts(sorted_inputs(a), sorted_products(b)) &&
+                same_amounts(sorted_inputs(b), sorted_products(a));
+        }
+
+        std::vector<FastPair> find_fast_pairs(const ReactionNetwork& network, const SlowScaleOptions& options) {
+            std::vector<FastPair> pairs{};
+
+            if (!options.fast_pairs.empty()) {
+                for (auto& [forward, backward]: options.fast_pairs) {
+                    if (!reverses(network.reactions.at(forward), network.reactions.at(backward))) {
+                        throw std::invalid_argument("Reactions " + std::to_string(forward) + " and " + std::to_string(backward) + " are not a reversible pair");
+                    }
+                    pairs.push_back({forward, backward});
+                }
+                return pairs;
+            }
+
+            std::vector<bool> used(network.reactions.size(), false);
+            for (size_t i = 0; i < network.reactions.size(); ++i) {
+                for (size_t j = i + 1; j < network.reactions.size() && !used[i]; ++j) {
+                    auto& a = network.reactions[i];
+                    auto& b = network.reactions[j];
+                    if (!used[j] && reverses(a, b) && std::max(a.rate, b.rate) >= options.fast_rate_threshold) {
+                        pairs.push_back({i, j});
+                        used[i] = used[j] = true;
+                    }
+                }
+            }
+            return pairs;
+        }
+
+        std::vector<FastSubsystem> group_pairs(const ReactionNetwork& network, const std::vector<FastPair>& pairs) {
+            std::vector<FastSubsystem> subsystems{};
+
+            for (auto& pair: pairs) {
+                auto& changes = network.reactions[pair.forward].changes;
+
+                // Merge every subsystem sharing a species with this pair
+                FastSubsystem merged{};
+                merged.pairs.push_back(pair);
+                for (auto& change: changes) {
+                    merged.species.push_back(change.species);
+                }
+
+                for (auto it = subsystems.begin(); it != subsystems.end();) {
+                    auto shares = std::any_of(changes.begin(), changes.end(), [&it](const SpeciesAmount& change){
+                        return std::find(it->species.begin(), it->species.end(), change.species) != it->species.end();
+                    });
+                    if (shares) {
+                        merged.pairs.insert(merged.pairs.end(), it->pairs.begin(), it->pairs.end());
+                        merged.species.insert(merged.species.end(), it->species.begin(), it->species.end());
+                        it = subsystems.erase(it);
+                    } else {
+                        it++;
+                    }
+                }
+
+                std::sort(merged.species.begin(), merged.species.end());
+                merged.species.erase(std::unique(merged.species.begin(), merged.species.end()), merged.species.end());
+                subsystems.push_back(std::move(merged));
+            }
+            return subsystems;
+        }
+
+        // Enumerates the states reachable through the fast pairs from the current amounts and weighs
+        // them by detailed balance, which gives the stationary distribution of the virtual fast process
+        void equilibrate(const ReactionNetwork& network, FastSubsystem& subsystem, std::vector<double_t>& scratch, size_t max_states) {
+            auto width = subsystem.species.size();
+            auto& log_weights = subsystem.probabilities;
+
+            subsystem.states.clear();
+            log_weights.clear();
+            for (auto s: subsystem.species) {
+                subsystem.states.push_back(scratch[s]);
+            }
+            log_weights.push_back(0);
+
+            auto load = [&](size_t state){
+                for (size_t i = 0; i < width; ++i) {
+                    scratch[subsystem.species[i]] = subsystem.states[state * width + i];
+                }
+            };
+            auto known = [&](){
+                for (size_t state = 0; state < log_weights.size(); ++state) {
+                    auto same = true;
+                    for (size_t i = 0; i < width && same; ++i) {
+                        same = subsystem.states[state * width + i] == scratch[subsystem.species[i]];
+                    }
+                    if (same) {
+                        return true;
+                    }
+                }
+                return false;
+            };
+
+            for (size_t state = 0; state < log_weights.size() && log_weights.size() < max_states; ++state) {
+                for (auto& pair: subsystem.pairs) {
+                    for (auto [r, reverse]: {std::pair{pair.forward, pair.backward}, std::pair{pair.backward, pair.forward}}) {
+                        load(state);
+                        if (!network.can_fire(r, scratch)) {
+                            continue;
+                        }
+                        auto a = network.propensity(r, scratch);
+                        network.fire(r, scratch);
+                        auto a_reverse = network.propensity(reverse, scratch);
+                        if (a <= 0 || a_reverse <= 0 || known()) {
+                            continue;
+                        }
+
+                        for (auto s: subsystem.species) {
+                            subsystem.states.push_back(scratch[s]);
+                        }
+                        log_weights.push_back(log_weights[state] + std::log(a) - std::log(a_reverse));
+                    }
+                }
+            }
+
+            auto max_weight = *std::max_element(log_weights.begin(), log_weights.end());
+            double_t total{0};
+            for (auto& weight: log_weights) {
+                weight = std::exp(weight - max_weight);
+                total += weight;
+            }
+            for (auto& probability: subsystem.probabilities) {
+                probability /= total;
+            }
+            subsystem.dirty = false;
+        }
+
+        // Product of the amounts a reaction's propensity depends on, restricted to the given species
+        double_t factor_product(const CompiledReaction& reaction, const std::vector<size_t>& species, std::span<const double_t> state) {
+            double_t product{1};
+            for (size_t i = 0; i < species.size(); ++i) {
+                for (auto& input: reaction.inputs) {
+                    if (input.species == species[i]) product *= state[i];
+                }
+                for (auto& catalyst: reaction.catalysts) {
+                    if (catalyst.species == species[i]) product *= state[i];
+                }
+            }
+            return product;
+        }
+    }
+
+    // Slow-scale SSA: only slow reactions are simulated, with propensities averaged over the
+    // partial equilibrium of the fast reversible subsystems
+    std::shared_ptr<SimulationTrajectory> Vessel::do_slow_scale_simulation(double_t end_time, const SlowScaleOptions& options, simulation_monitor& monitor) {
+        ReactionNetwork network{*this};
+        if (network.has_delays()) {
+            throw std::invalid_argument("Delayed reactions are not supported by the slow-scale simulation");
+        }
+        SimulationTrajectory trajectory{reactants};
+        trajectory.reserve(reserved_rows());
+        SimulationState state{reactants, 0};
+        auto engine = make_random_engine();
+        std::uniform_real_distribution<double_t> uniform{0.0, 1.0};
+
+        // The enumeration stops at max_fast_states, but the states reached from the last one are still added
+        auto subsystems = group_pairs(network, find_fast_pairs(network, options));
+        size_t most_states{0};
+        for (auto& subsystem: subsystems) {
+            auto states = options.max_fast_states + 2 * subsystem.pairs.size();
+            subsystem.states.reserve(states * subsystem.species.size());
+            subsystem.probabilities.reserve(states);
+            most_states = std::max(most_states, states);
+        }
+
+        std::vector<bool> fast_species(network.species.size(), false);
+        std::vector<bool> fast_reaction(network.reactions.size(), false);
+        for (auto& subsystem: subsystems) {
+            for (auto s: subsystem.species) fast_species[s] = true;
+            for (auto& pair: subsystem.pairs) fast_reaction[pair.forward] = fast_reaction[pair.backward] = true;
+        }
+        std::vector<size_t> slow{};
+        for (size_t r = 0; r < network.reactions.size(); ++r) {
+            if (!fast_reaction[r]) slow.push_back(r);
+        }
+
+        auto x = network.initial_amounts();
+        auto scratch = x;
+        std::vector<double_t> cumulative(slow.size());
+        std::vector<double_t> weights{};
+        weights.reserve(most_states);
+
+        trajectory.insert(0, x);
+        double_t t{0};
+
+        auto& interventions = network.interventions;
+        size_t next_intervention{0};
+
+        while (t <= end_time) {
+            // The distribution only changes when a slow reaction moved one of the subsystem's species
+            for (auto& subsystem: subsystems) {
+                if (subsystem.dirty) {
+                    std::copy(x.begin(), x.end(), scratch.begin());
+                    equilibrate(network, subsystem, scratch, options.max_fast_states);
+                }
+            }
+
+            // Effective propensity: the subsystems are independent of each other, so the expectation
+            // of the product is the product of the expectations over each subsystem
+            double_t total{0};
+            for (size_t i = 0; i < slow.size(); ++i) {
+                auto& reaction = network.reactions[slow[i]];
+                auto a = reaction.enabled ? reaction.rate : 0.0;
+                for (auto& input: reaction.inputs) {
+                    if (!fast_species[input.species]) a *= x[input.species];
+                }
+                for (auto& catalyst: reaction.catalysts) {
+                    if (!fast_species[catalyst.species]) a *= x[catalyst.species];
+                }
+                for (auto& subsystem: subsystems) {
+                    double_t expectation{0};
+                    for (size_t s = 0; s < subsystem.size(); ++s) {
+                        expectation += subsystem.probabilities[s] * factor_product(reaction, subsystem.species, subsystem.state(s));
+                    }
+                    a *= expectation;
+                }
+                total += a;
+                cumulative[i] = total;
+            }
+
+            // An intervention before the next slow reaction is applied first and everything is recomputed
+            auto delay = total > 0 ? std::exponential_distribution<double_t>(total)(engine) : std::numeric_limits<double_t>::infinity();
+            if (next_intervention < interventions.size() && interventions[next_intervention].time <= std::min(t + delay, end_time)) {
+                t = std::max(t, interventions[next_intervention].time);
+                while (next_intervention < interventions.size() && interventions[next_intervention].time <= t) {
+                    network.apply(interventions[next_intervention++], x);
+                }
+                for (auto& subsystem: subsystems) {
+                    subsystem.dirty = true;
+                }
+                trajectory.insert(t, x);
+                continue;
+            }
+
+            if (total <= 0) {
+                break;
+            }
+
+            t += delay;
+            auto selected = std::min<size_t>(std::upper_bound(cumulative.begin(), cumulative.end(), uniform(engine) * total) - cumulative.begin(), slow.size() - 1);
+            auto& reaction = network.reactions[slow[selected]];
+
+            // Given that the reaction fires, each fast subsystem is in a state weighted by its contribution
+            for (auto& subsystem: subsystems) {
+                weights.clear();
+                double_t weight_total{0};
+                for (size_t s = 0; s < subsystem.size(); ++s) {
+                    weight_total += subsystem.probabilities[s] * factor_product(reaction, subsystem.species, subsystem.state(s));
+                    weights.push_back(weight_total);
+                }
+                auto chosen = std::min<size_t>(std::upper_bound(weights.begin(), weights.end(), uniform(engine) * weight_total) - weights.begin(), subsystem.size() - 1);
+                auto amounts = subsystem.state(chosen);
+                for (size_t i = 0; i < subsystem.species.size(); ++i) {
+                    x[subsystem.species[i]] = amounts[i];
+                }
+            }
+
+            if (network.can_fire(slow[selected], x)) {
+                network.fire(slow[selected], x);
+
+                for (auto& subsystem: subsystems) {
+                    for (auto& change: reaction.changes) {
+                        if (std::find(subsystem.species.begin(), subsystem.species.end(), change.species) != subsystem.species.end()) {
+                            subsystem.dirty = true;
+                        }
+                    }
+                }
+            }
+
+            trajectory.insert(t, x);
+
+            state.time = t;
+            for (size_t i = 0; i < x.size(); ++i) {
+                state.reactants[Symbol{i}].amount = x[i];
+            }
+            monitor.monitor(state);
+        }
+
+        record_run(trajectory.size());
+        return std::make_shared<SimulationTrajectory>(std::move(trajectory));
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef SP_EXAM_PROJECT_SLOW_SCALE_H
+#define SP_EXAM_PROJECT_SLOW_SCALE_H
+
+#include <cmath>
+#include <vector>
+#include <utility>
+
+namespace StochasticSimulation {
+
+    // Fast reversible pairs are found among reactions whose changes cancel each other out, a pair is
+    // fast when one of its directions has at least fast_rate_threshold as rate. Pairs of reaction
+    // indices (in the order they were added to the vessel) can be given instead to skip the detection.
+    struct SlowScaleOptions {
+        double_t fast_rate_threshold{10};
+        std::vector<std::pair<size_t, size_t>> fast_pairs{};
+        size_t max_fast_states{10000};  // bound on the enumerated partial equilibrium states of a fast subsystem
+    };
+}
+
+#endif //SP_EXAM_PROJECT_SLOW_SCALE_H
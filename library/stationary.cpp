@@ -0,0 +1,341 @@
+#include <bit>
+#include <complex>
+#include <numbers>
+#include "stationary.h"
+
+namespace StochasticSimulation {
+
+    namespace {
+        void parallel_for(size_t n, size_t threads, const std::function<void(size_t)>& body) {
+            auto jobs = threads == 0 ? std::max<size_t>(1, std::thread::hardware_concurrency()) : threads;
+            jobs = std::max<size_t>(1, std::min(jobs, n));
+
+            auto futures = std::vector<std::future<void>>{};
+            for (size_t job = 0; job < jobs; ++job) {
+                futures.push_back(std::async(std::launch::async, [&body, begin = n * job / jobs, end = n * (job + 1) / jobs]() {
+                    for (auto i = begin; i < end; ++i) {
+                        body(i);
+                    }
+                }));
+            }
+            for (auto& future: futures) {
+                future.get();
+            }
+        }
+
+        // Iterative radix-2 transform, the size must be a power of two
+        void fft(std::vector<std::complex<double_t>>& values, bool inverse) {
+            auto n = values.size();
+            for (size_t i = 1, j = 0; i < n; ++i) {
+                auto bit = n >> 1;
+                for (; j & bit; bit >>= 1) {
+                    j ^= bit;
+                }
+                j ^= bit;
+                if (i < j) {
+                    std::swap(values[i], values[j]);
+                }
+            }
+
+            for (size_t length = 2; length <= n; length <<= 1) {
+                auto angle = 2 * std::numbers::pi / static_cast<double_t>(length) * (inverse ? 1 : -1);
+                auto root = std::complex<double_t>{std::cos(angle), std::sin(angle)};
+                for (size_t start = 0; start < n; start += length) {
+                    auto twiddle = std::complex<double_t>{1, 0};
+                    for (size_t i = 0; i < length / 2; ++i) {
+                        auto even = values[start + i];
+                        auto odd = values[start + i + length / 2] * twiddle;
+                        values[start + i] = even + odd;
+                        values[start + i + length / 2] = even - odd;
+                        twiddle *= root;
+                    }
+                }
+            }
+        }
+
+        // Adds the products x_t * x_t+k whose later sample is in the block: the cross-correlation of
+        // u = history ++ block with v, the same series with the history zeroed. Both are real, so they are
+        // transformed together as u + iv. values is the buffer of the transform, reused between calls.
+        void accumulate(const std::vector<double_t>& history, const std::vector<double_t>& block, size_t max_lag,
+                        std::vector<double_t>& products, std::vector<double_t>& pairs, std::vector<std::complex<double_t>>& values) {
+            if (block.empty()) {
+                return;
+            }
+
+            auto h = history.size();
+            auto length = h + block.size();
+            // Padding past the longest lag keeps the circular correlation from wrapping around
+            values.assign(std::bit_ceil(length + max_lag), {0, 0});
+            for (size_t t = 0; t < h; ++t) {
+                values[t] = {history[t], 0};
+            }
+            for (size_t t = 0; t < block.size(); ++t) {
+                values[h + t] = {block[t], block[t]};
+            }
+
+            fft(values, false);
+            // U = (Z[k] + conj(Z[n-k])) / 2 and V = (Z[k] - conj(Z[n-k])) / 2i, the correlation is conj(U) V.
+            // It is real, so bin n-k holds the conjugate of bin k.
+            auto n = values.size();
+            for (size_t k = 0; k <= n / 2; ++k) {
+                auto mirror = (n - k) % n;
+                auto u = (values[k] + std::conj(values[mirror])) * 0.5;
+                auto v = (values[k] - std::conj(values[mirror])) * std::complex<double_t>{0, -0.5};
+                values[k] = std::conj(u) * v;
+                values[mirror] = std::conj(values[k]);
+            }
+            fft(values, true);
+
+            auto scale = static_cast<double_t>(n);
+            for (size_t k = 0; k <= max_lag && k < length; ++k) {
+                products[k] += values[k].real() / scale;
+                pairs[k] += static_cast<double_t>(length - std::max(h, k));
+            }
+        }
+    }
+
+    TimeWeightedHistogram::TimeWeightedHistogram(double_t low, double_t bin_width, size_t bins):
+        low(low),
+        bin_width(bin_width),
+        weights(bins, 0.0)
+    {
+        if (bin_width <= 0) {
+            throw std::invalid_argument("Histogram bins must have a positive width");
+        }
+    }
+
+    void TimeWeightedHistogram::add(double_t value, double_t duration) {
+        if (duration <= 0) {
+            return;
+        }
+        total += duration;
+
+        auto bin = std::floor((value - low) / bin_width);
+        if (bin < 0) {
+            underflow += duration;
+        } else if (bin >= static_cast<double_t>(weights.size())) {
+            overflow += duration;
+        } else {
+            weights[static_cast<size_t>(bin)] += duration;
+        }
+    }
+
+    void TimeWeightedHistogram::merge(const TimeWeightedHistogram& other) {
+        if (other.weights.size() != weights.size() || other.low != low || other.bin_width != bin_width) {
+            throw std::invalid_argument("Only histograms with the same bins can be merged");
+        }
+        for (size_t i = 0; i < weights.size(); ++i) {
+            weights[i] += other.weights[i];
+        }
+        underflow += other.underflow;
+        overflow += other.overflow;
+        total += other.total;
+    }
+
+    void TimeWeightedMoments::add(double_t value, double_t duration) {
+        if (duration <= 0) {
+            return;
+        }
+        total += duration;
+        auto delta = value - average;
+        average += delta * duration / total;
+        squares += duration * delta * (value - average);
+        lowest = std::min(lowest, value);
+        highest = std::max(highest, value);
+    }
+
+    // Chan's pairwise combination of the two means and sums of squares
+    void TimeWeightedMoments::merge(const TimeWeightedMoments& other) {
+        if (other.total <= 0) {
+            return;
+        }
+        auto combined = total + other.total;
+        auto delta = other.average - average;
+        average += delta * other.total / combined;
+        squares += other.squares + delta * delta * total * other.total / combined;
+        total = combined;
+        lowest = std::min(lowest, other.lowest);
+        highest = std::max(highest, other.highest);
+    }
+
+    BlockAutocorrelation::BlockAutocorrelation(size_t max_lag):
+        max_lag(max_lag),
+        block_size(std::max<size_t>(4 * max_lag, 64)),
+        products(max_lag + 1, 0.0),
+        pairs(max_lag + 1, 0.0)
+    {
+        history.reserve(max_lag);
+        block.reserve(block_size);
+    }
+
+    void BlockAutocorrelation::add(double_t sample) {
+        block.push_back(sample);
+        count++;
+        sum += sample;
+        if (block.size() == block_size) {
+            flush();
+        }
+    }
+
+    void BlockAutocorrelation::flush() {
+        accumulate(history, block, max_lag, products, pairs, spectrum);
+
+        // Keep the last max_lag samples of history ++ block
+        auto keep = std::min(max_lag, history.size() + block.size());
+        auto from_block = std::min(keep, block.size());
+        history.erase(history.begin(), history.end() - static_cast<std::ptrdiff_t>(keep - from_block));
+        history.insert(history.end(), block.end() - static_cast<std::ptrdiff_t>(from_block), block.end());
+        block.clear();
+    }
+
+    void BlockAutocorrelation::end_series() {
+        flush();
+        history.clear();
+    }
+
+    void BlockAutocorrelation::merge(const BlockAutocorrelation& other) {
+        if (other.max_lag != max_lag) {
+            throw std::invalid_argument("Only autocorrelations with the same lags can be merged");
+        }
+        for (size_t k = 0; k <= max_lag; ++k) {
+            products[k] += other.products[k];
+            pairs[k] += other.pairs[k];
+        }
+        // The series the other was still collecting ends here
+        accumulate(other.history, other.block, max_lag, products, pairs, spectrum);
+        count += other.count;
+        sum += other.sum;
+    }
+
+    std::vector<double_t> BlockAutocorrelation::autocorrelation() const {
+        auto all_products = products;
+        auto all_pairs = pairs;
+        std::vector<std::complex<double_t>> values{};
+        accumulate(history, block, max_lag, all_products, all_pairs, values);
+
+        std::vector<double_t> result(max_lag + 1, std::numeric_limits<double_t>::quiet_NaN());
+        if (count == 0) {
+            return result;
+        }
+        auto mean = sum / static_cast<double_t>(count);
+        auto variance = all_products[0] / all_pairs[0] - mean * mean;
+        if (variance <= 0) {
+            return result;
+        }
+        for (size_t k = 0; k <= max_lag; ++k) {
+            if (all_pairs[k] > 0) {
+                result[k] = (all_products[k] / all_pairs[k] - mean * mean) / variance;
+            }
+        }
+        return result;
+    }
+
+    stationary_simulation_monitor::stationary_simulation_monitor(const SymbolTable<Reactant>& species, std::vector<std::string> names, const StationaryOptions& options):
+        options(options),
+        names(std::move(names))
+    {
+        if (options.sample_interval <= 0) {
+            throw std::invalid_argument("The sample interval must be positive");
+        }
+        for (auto& name: this->names) {
+            auto symbol = species.symbol(name);
+            symbols.push_back(symbol);
+            initial.push_back(species[symbol].amount);
+            statistics.push_back(SpeciesStationary{
+                TimeWeightedHistogram{options.low, options.bin_width, options.bins},
+                TimeWeightedMoments{},
+                BlockAutocorrelation{options.max_lag}
+            });
+        }
+        last = initial;
+    }
+
+    // Credits the amounts held since the last event up to time and samples them on the grid points before it
+    void stationary_simulation_monitor::advance(double_t time) {
+        auto from = std::max(last_time, options.burn_in);
+        if (time > from) {
+            for (size_t i = 0; i < statistics.size(); ++i) {
+                statistics[i].histogram.add(last[i], time - from);
+                statistics[i].moments.add(last[i], time - from);
+            }
+        }
+
+        for (auto sample_time = options.burn_in + static_cast<double_t>(next_sample) * options.sample_interval;
+             sample_time < time;
+             sample_time = options.burn_in + static_cast<double_t>(++next_sample) * options.sample_interval) {
+            for (size_t i = 0; i < statistics.size(); ++i) {
+                statistics[i].autocorrelation.add(last[i]);
+            }
+        }
+        last_time = std::max(last_time, time);
+    }
+
+    void stationary_simulation_monitor::monitor(SimulationState& state) {
+        advance(state.time);
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            last[i] = state.reactants[symbols[i]].amount;
+        }
+    }
+
+    void stationary_simulation_monitor::add(double_t time, std::span<const double_t> amounts) {
+        advance(time);
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            last[i] = amounts[symbols[i].id];
+        }
+    }
+
+    void stationary_simulation_monitor::finish(double_t end_time) {
+        advance(end_time);
+        for (auto& species: statistics) {
+            species.autocorrelation.end_series();
+        }
+
+        last = initial;
+        last_time = 0;
+        next_sample = 0;
+    }
+
+    void stationary_simulation_monitor::merge(const stationary_simulation_monitor& other) {
+        if (other.names != names) {
+            throw std::invalid_argument("Only collectors of the same species can be merged");
+        }
+        for (size_t i = 0; i < statistics.size(); ++i) {
+            statistics[i].histogram.merge(other.statistics[i].histogram);
+            statistics[i].moments.merge(other.statistics[i].moments);
+            statistics[i].autocorrelation.merge(other.statistics[i].autocorrelation);
+        }
+    }
+
+    const SpeciesStationary& stationary_simulation_monitor::operator[](std::string_view name) const {
+        auto found = std::find(names.begin(), names.end(), name);
+        if (found == names.end()) {
+            throw std::out_of_range("Species " + std::string(name) + " is not collected");
+        }
+        return statistics[static_cast<size_t>(found - names.begin())];
+    }
+
+    stationary_simulation_monitor collect_stationary(const Vessel& vessel, double_t end_time, const std::vector<std::string>& names,
+                                                     const StationaryOptions& options, size_t replicas, size_t threads) {
+        std::vector<stationary_simulation_monitor> collectors(std::max<size_t>(replicas, 1),
+                                                               stationary_simulation_monitor{vessel.get_reactants(), names, options});
+
+        // Every replica gets its own stream, replicas run one after another on a thread would otherwise
+        // seed their engines alike
+        auto seed = options.seed.has_value() ? options.seed.value() : (static_cast<uint64_t>(std::random_device{}()) << 32) | std::random_device{}();
+
+        parallel_for(collectors.size(), threads, [&](size_t replica) {
+            auto& collector = collectors[replica];
+            std::seed_seq sequence{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32), static_cast<uint32_t>(replica)};
+            // The first point is the initial state the collector already starts from
+            for (auto point: vessel.simulate(end_time, std::default_random_engine{sequence})) {
+                collector.add(point.time, point.amounts);
+            }
+            collector.finish(end_time);
+        });
+
+        for (size_t replica = 1; replica < collectors.size(); ++replica) {
+            collectors[0].merge(collectors[replica]);
+        }
+        return std::move(collectors[0]);
+    }
+}
@@ -0,0 +1,170 @@
+#ifndef SP_EXAM_PROJECT_STATIONARY_H
+#define SP_EXAM_PROJECT_STATIONARY_H
+
+#include <complex>
+#include "simulation.h"
+
+namespace StochasticSimulation {
+
+    struct StationaryOptions {
+        double_t burn_in{0};             // time discarded at the start of every run
+        double_t low{0};                 // histogram bins are [low + i * bin_width, low + (i + 1) * bin_width)
+        double_t bin_width{1};
+        size_t bins{1000};               // amounts outside the bins are only counted as under- or overflow
+        double_t sample_interval{1};     // grid the autocorrelation resamples the amounts on
+        size_t max_lag{256};             // autocorrelation lags, in samples
+        std::optional<uint64_t> seed{};  // replica r draws from (seed, r), without a seed one is drawn
+    };
+
+    // Fraction of the time spent in every bin
+    class TimeWeightedHistogram {
+    private:
+        double_t low;
+        double_t bin_width;
+        std::vector<double_t> weights;
+        double_t underflow{0};
+        double_t overflow{0};
+        double_t total{0};
+    public:
+        TimeWeightedHistogram(double_t low, double_t bin_width, size_t bins);
+
+        void add(double_t value, double_t duration);
+        void merge(const TimeWeightedHistogram& other);
+
+        [[nodiscard]] size_t bins() const {
+            return weights.size();
+        }
+
+        [[nodiscard]] double_t bin_start(size_t bin) const {
+            return low + static_cast<double_t>(bin) * bin_width;
+        }
+
+        [[nodiscard]] double_t probability(size_t bin) const {
+            return total > 0 ? weights[bin] / total : 0.0;
+        }
+
+        [[nodiscard]] double_t probability_below() const {
+            return total > 0 ? underflow / total : 0.0;
+        }
+
+        [[nodiscard]] double_t probability_above() const {
+            return total > 0 ? overflow / total : 0.0;
+        }
+
+        [[nodiscard]] double_t total_time() const {
+            return total;
+        }
+    };
+
+    // Time-weighted mean and variance (West's weighted update), minimum and maximum
+    class TimeWeightedMoments {
+    private:
+        double_t total{0};
+        double_t average{0};
+        double_t squares{0};
+        double_t lowest{std::numeric_limits<double_t>::infinity()};
+        double_t highest{-std::numeric_limits<double_t>::infinity()};
+    public:
+        void add(double_t value, double_t duration);
+        void merge(const TimeWeightedMoments& other);
+
+        [[nodiscard]] double_t mean() const {
+            return average;
+        }
+
+        [[nodiscard]] double_t variance() const {
+            return total > 0 ? squares / total : 0.0;
+        }
+
+        [[nodiscard]] double_t min() const {
+            return lowest;
+        }
+
+        [[nodiscard]] double_t max() const {
+            return highest;
+        }
+
+        [[nodiscard]] double_t total_time() const {
+            return total;
+        }
+    };
+
+    // Autocorrelation of evenly spaced samples. Samples are gathered in blocks, the lagged products of a
+    // block with itself and the max_lag samples before it are summed through an FFT, so memory stays fixed
+    // however long the series. Separate series (runs) are never paired with each other.
+    class BlockAutocorrelation {
+    private:
+        size_t max_lag;
+        size_t block_size;
+        std::vector<double_t> history{};   // last max_lag samples before the block, of the current series
+        std::vector<double_t> block{};
+        std::vector<double_t> products;    // sum of x_t * x_t+k for every lag k
+        std::vector<double_t> pairs;       // number of products summed for every lag
+        std::vector<std::complex<double_t>> spectrum{};  // buffer of the transform, kept between blocks
+        size_t count{0};
+        double_t sum{0};
+
+        void flush();
+    public:
+        explicit BlockAutocorrelation(size_t max_lag);
+
+        void add(double_t sample);
+
+        // The next sample starts a new series
+        void end_series();
+
+        void merge(const BlockAutocorrelation& other);
+
+        // Correlation at lags 0..max_lag around the mean of all samples, NaN where it is not defined
+        [[nodiscard]] std::vector<double_t> autocorrelation() const;
+
+        [[nodiscard]] size_t samples() const {
+            return count;
+        }
+    };
+
+    struct SpeciesStationary {
+        TimeWeightedHistogram histogram;
+        TimeWeightedMoments moments;
+        BlockAutocorrelation autocorrelation;
+    };
+
+    // Stationary statistics of some species from long runs, kept in fixed memory while simulating. The
+    // amount held between two events is weighted by the time it is held. The simulations insert their
+    // initial state without calling the monitor, so every run starts from the amounts of the species table.
+    // A run ends with finish(end_time), which counts the last amounts until the end.
+    class stationary_simulation_monitor: public simulation_monitor {
+    private:
+        StationaryOptions options;
+        std::vector<std::string> names;
+        std::vector<Symbol> symbols;
+        std::vector<double_t> initial;
+        std::vector<SpeciesStationary> statistics{};
+
+        double_t last_time{0};
+        std::vector<double_t> last;
+        size_t next_sample{0};
+
+        void advance(double_t time);
+    public:
+        stationary_simulation_monitor(const SymbolTable<Reactant>& species, std::vector<std::string> names, const StationaryOptions& options = {});
+
+        void monitor(SimulationState& state) override;
+
+        // State after an event, amounts by species id
+        void add(double_t time, std::span<const double_t> amounts);
+
+        void finish(double_t end_time);
+
+        // Adds the statistics of an independent replica collecting the same species with the same options
+        void merge(const stationary_simulation_monitor& other);
+
+        [[nodiscard]] const SpeciesStationary& operator[](std::string_view name) const;
+    };
+
+    // Runs the replicas in parallel without keeping their trajectories and merges what they collected
+    stationary_simulation_monitor collect_stationary(const Vessel& vessel, double_t end_time, const std::vector<std::string>& names,
+                                                     const StationaryOptions& options = {}, size_t replicas = 1, size_t threads = 0);
+}
+
+#endif //SP_EXAM_PROJECT_STATIONARY_H
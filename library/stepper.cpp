@@ -0,0 +1,200 @@
+#include <limits>
+#include "stepper.h"
+#include "analysis.h"
+
+namespace StochasticSimulation {
+
+    DirectMethodStepper::DirectMethodStepper(ReactionNetwork compiled, std::default_random_engine engine, SsaEngine selection):
+        network(std::move(compiled)),
+        engine(engine),
+        propensities(selection, network.reactions.size()),
+        dependents(network.species.size()),
+        dead(find_dead_reactions(network)),
+        amounts(network.initial_amounts())
+    {
+        for (size_t r = 0; r < network.reactions.size(); ++r) {
+            if (dead[r]) {
+                continue;
+            }
+            auto& reaction = network.reactions[r];
+            for (auto& input: reaction.inputs) {
+                dependents[input.species].push_back(r);
+            }
+            for (auto& catalyst: reaction.catalysts) {
+                dependents[catalyst.species].push_back(r);
+            }
+        }
+        for (auto& list: dependents) {
+            std::sort(list.begin(), list.end());
+            list.erase(std::unique(list.begin(), list.end()), list.end());
+        }
+
+        refresh();
+    }
+
+    void DirectMethodStepper::refresh() {
+        steps_since_refresh = 0;
+        for (size_t r = 0; r < network.reactions.size(); ++r) {
+            if (!dead[r]) {
+                propensities.update(r, network.propensity(r, amounts));
+            }
+        }
+        propensities.rebuild();
+    }
+
+    void DirectMethodStepper::update_dependents(size_t species) {
+        for (auto r: dependents[species]) {
+            propensities.update(r, network.propensity(r, amounts));
+        }
+    }
+
+    void DirectMethodStepper::update_reaction(size_t reaction) {
+        if (!dead[reaction]) {
+            propensities.update(reaction, network.propensity(reaction, amounts));
+        }
+    }
+
+    // Applies every intervention scheduled at the next intervention time
+    void DirectMethodStepper::apply_interventions() {
+        auto& interventions = network.interventions;
+        auto at = interventions[next_intervention].time;
+
+        while (next_intervention < interventions.size() && interventions[next_intervention].time == at) {
+            auto& intervention = interventions[next_intervention++];
+            auto target = network.apply(intervention, amounts);
+            if (intervention.kind == Intervention::Kind::amount) {
+                update_dependents(target);
+            } else {
+                update_reaction(target);
+            }
+        }
+    }
+
+    void DirectMethodStepper::complete_next() {
+        auto completion = pending.pop();
+        time = std::max(time, completion.time);
+        network.complete(completion.reaction, amounts);
+        for (auto& product: network.reactions[completion.reaction].products) {
+            update_dependents(product.species);
+        }
+    }
+
+    bool DirectMethodStepper::step(double_t until) {
+        // The running total drifts with floating point errors, recompute it now and then
+        if (++steps_since_refresh == 4096) {
+            refresh();
+        }
+
+        // Interventions and completions of delayed reactions are points in time where the next
+        // reaction is sampled again
+        auto intervention_time = next_intervention < network.interventions.size()
+                ? network.interventions[next_intervention].time
+                : std::numeric_limits<double_t>::infinity();
+        auto completion_time = pending.next_time();
+        auto bound = std::min({until, intervention_time, completion_time});
+
+        auto total = propensities.total();
+        auto delay = total > 0 ? std::exponential_distribution<double_t>(total)(engine) : std::numeric_limits<double_t>::infinity();
+        if (time + delay > bound) {
+            if (completion_time <= until && completion_time <= intervention_time) {
+                complete_next();
+                return true;
+            }
+            if (intervention_time <= until) {
+                time = std::max(time, intervention_time);
+                apply_interventions();
+                return true;
+            }
+            time = std::max(time, until);
+            return false;
+        }
+
+        time += delay;
+        auto r = propensities.select(engine);
+
+        if (network.can_fire(r, amounts)) {
+            auto& reaction = network.reactions[r];
+            if (reaction.delay.has_value()) {
+                network.start(r, amounts);
+                for (auto& input: reaction.inputs) {
+                    update_dependents(input.species);
+                }
+                pending.push(time + reaction.delay->sample(engine), r);
+            } else {
+                network.fire(r, amounts);
+                for (auto& change: reaction.changes) {
+                    update_dependents(change.species);
+                }
+            }
+        }
+        events++;
+
+        return true;
+    }
+
+    static Generator<TrajectoryPoint> simulate_network(ReactionNetwork network, double_t end_time, std::default_random_engine engine, SsaEngine selection) {
+        DirectMethodStepper stepper{std::move(network), engine, selection};
+
+        co_yield TrajectoryPoint{stepper.time, stepper.amounts};
+        while (stepper.step(end_time)) {
+            co_yield TrajectoryPoint{stepper.time, stepper.amounts};
+        }
+    }
+
+    Generator<TrajectoryPoint> Vessel::simulate(double_t end_time, SsaEngine selection) const {
+        return simulate_network(ReactionNetwork{*this}, end_time, make_random_engine(), selection);
+    }
+
+    Generator<TrajectoryPoint> Vessel::simulate(double_t end_time, std::default_random_engine engine, SsaEngine selection) const {
+        return simulate_network(ReactionNetwork{*this}, end_time, engine, selection);
+    }
+
+    std::shared_ptr<SimulationTrajectory> Vessel::do_simulation(double_t end_time, SsaEngine selection, simulation_monitor& monitor) {
+        return do_stepper_simulation(end_time, selection, monitor, std::stop_token{});
+    }
+
+    size_t Vessel::reserved_rows() const {
+        auto rows = expected_rows.load(std::memory_order_relaxed);
+        return rows + rows / 4;
+    }
+
+    size_t Vessel::reserved_in_flight() const {
+        auto in_flight = expected_in_flight.load(std::memory_order_relaxed);
+        return in_flight + in_flight / 4;
+    }
+
+    void Vessel::record_run(size_t rows, size_t in_flight) const {
+        // Concurrent runs only ever raise the sizes
+        auto raise = [](std::atomic<size_t>& expected, size_t size) {
+            auto current = expected.load(std::memory_order_relaxed);
+            while (size > current && !expected.compare_exchange_weak(current, size, std::memory_order_relaxed)) {}
+        };
+        raise(expected_rows, rows);
+        raise(expected_in_flight, in_flight);
+    }
+
+    // Everything a run needs is allocated before the loop: the stepper, the state given to the monitor,
+    // the queue of delayed reactions and the trajectory, reserved from the longest run of this vessel.
+    // An event only writes into these, they grow only when a run is longer than expected.
+    std::shared_ptr<SimulationTrajectory> Vessel::do_stepper_simulation(double_t end_time, SsaEngine selection, simulation_monitor& monitor, std::stop_token stop_token) {
+        DirectMethodStepper stepper{ReactionNetwork{*this}, make_random_engine(), selection};
+        stepper.reserve_in_flight(reserved_in_flight());
+        SimulationState state{reactants, 0};
+        auto trajectory = std::make_shared<SimulationTrajectory>(reactants);
+        trajectory->reserve(reserved_rows());
+        trajectory->insert(0, stepper.amounts);
+
+        while (!stop_token.stop_requested() && stepper.step(end_time)) {
+            trajectory->insert(stepper.time, stepper.amounts);
+
+            state.time = stepper.time;
+            for (size_t i = 0; i < stepper.amounts.size(); ++i) {
+                state.reactants[Symbol{i}].amount = stepper.amounts[i];
+            }
+            monitor.monitor(state);
+        }
+
+        record_run(trajectory->size(), stepper.peak_in_flight());
+        return trajectory;
+    }
+}
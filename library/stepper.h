@@ -0,0 +1,76 @@
+#ifndef SP_EXAM_PROJECT_STEPPER_H
+#define SP_EXAM_PROJECT_STEPPER_H
+
+#include "network.h"
+
+namespace StochasticSimulation {
+
+    // Exact direct method stepper on a compiled network which can be advanced in pieces, only the
+    // propensities of reactions reading a changed species are recomputed after an event. The firing
+    // reaction is picked by a linear scan, a Fenwick tree search or composition-rejection. The stepper
+    // owns its copy of the network, so the scheduled interventions only change this run. Delayed
+    // reactions in flight are kept in a priority queue and completed in time order. Reactions the
+    // network analysis finds can never fire are skipped.
+    class DirectMethodStepper {
+    private:
+        ReactionNetwork network;
+        std::default_random_engine engine;
+        size_t next_intervention{0};
+        CompletionQueue pending{};
+        PropensityIndex propensities;
+        std::vector<std::vector<size_t>> dependents{};  // species id -> reactions whose propensity reads it
+        std::vector<bool> dead{};                       // never evaluated, their propensity stays 0
+        size_t steps_since_refresh{0};                  // every step counts, not only fired reactions
+
+        void update_dependents(size_t species);
+        void update_reaction(size_t reaction);
+        void apply_interventions();
+        void complete_next();
+    public:
+        std::vector<double_t> amounts;
+        double_t time{0};
+        size_t events{0};
+
+        DirectMethodStepper(ReactionNetwork network, std::default_random_engine engine, SsaEngine selection = SsaEngine::direct);
+
+        // Fires the next reaction, completes the next delayed reaction or applies the next interventions
+        // if that happens before until and returns true, otherwise the time is moved to until and false
+        // is returned
+        bool step(double_t until);
+
+        // Recompute every propensity after the amounts were changed from outside
+        void refresh();
+
+        // A copy draws the same random numbers as the original until it gets its own engine
+        void reseed(std::default_random_engine new_engine) {
+            engine = new_engine;
+        }
+
+        // Recompute the propensities depending on a species changed from outside
+        void changed(size_t species) {
+            update_dependents(species);
+        }
+
+        [[nodiscard]] double_t total_propensity() const {
+            return propensities.total();
+        }
+
+        [[nodiscard]] size_t in_flight() const {
+            return pending.size();
+        }
+
+        void reserve_in_flight(size_t in_flight) {
+            pending.reserve(in_flight);
+        }
+
+        [[nodiscard]] size_t peak_in_flight() const {
+            return pending.peak_size();
+        }
+
+        [[nodiscard]] const ReactionNetwork& get_network() const {
+            return network;
+        }
+    };
+}
+
+#endif //SP_EXAM_PROJECT_STEPPER_H
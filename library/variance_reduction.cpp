@@ -0,0 +1,342 @@
+#include <array>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+#include "variance_reduction.h"
+#include "network.h"
+
+namespace StochasticSimulation {
+
+    namespace {
+        // Regularized lower incomplete gamma function P(a, x), by its series below a + 1 and by the
+        // continued fraction of the upper function above
+        double_t gamma_cdf(double_t a, double_t x) {
+            if (x <= 0) {
+                return 0.0;
+            }
+            auto scale = std::exp(-x + a * std::log(x) - std::lgamma(a));
+            if (x < a + 1) {
+                auto term = 1.0 / a;
+                auto sum = term;
+                for (auto n = a + 1; n < a + 1000; n += 1) {
+                    term *= x / n;
+                    sum += term;
+                    if (std::abs(term) < std::abs(sum) * 1e-15) {
+                        break;
+                    }
+                }
+                return std::min(1.0, sum * scale);
+            }
+
+            constexpr auto tiny = std::numeric_limits<double_t>::min() / std::numeric_limits<double_t>::epsilon();
+            auto b = x + 1 - a;
+            auto c = 1.0 / tiny;
+            auto d = 1.0 / b;
+            auto h = d;
+            for (size_t i = 1; i < 1000; ++i) {
+                auto an = -static_cast<double_t>(i) * (static_cast<double_t>(i) - a);
+                b += 2;
+                d = an * d + b;
+                d = std::abs(d) < tiny ? tiny : d;
+                c = b + an / c;
+                c = std::abs(c) < tiny ? tiny : c;
+                d = 1.0 / d;
+                h *= d * c;
+                if (std::abs(d * c - 1) < 1e-15) {
+                    break;
+                }
+            }
+            return std::max(0.0, 1.0 - scale * h);
+        }
+
+        // Latency with cumulative probability u, so a latency drawn from u and one drawn from 1 - u are
+        // as negatively correlated as the waiting times. The gamma quantile is found by bisection of the cdf.
+        double_t delay_quantile(const ReactionDelay& delay, double_t u) {
+            switch (delay.distribution) {
+                case ReactionDelay::Distribution::uniform:
+                    return delay.first + u * (delay.second - delay.first);
+                case ReactionDelay::Distribution::gamma: {
+                    auto low = 0.0;
+                    auto high = std::max(1.0, delay.first);
+                    while (gamma_cdf(delay.first, high) < u && high < 1e300) {
+                        high *= 2;
+                    }
+                    for (size_t i = 0; i < 100 && high - low > 1e-12 * high; ++i) {
+                        auto middle = (low + high) / 2;
+                        (gamma_cdf(delay.first, middle) < u ? low : high) = middle;
+                    }
+                    return delay.second * (low + high) / 2;
+                }
+                default:
+                    return delay.first;
+            }
+        }
+
+        // Random stream of a single reaction. The antithetic stream turns every uniform u into 1 - u,
+        // so a long waiting time or latency in one run is a short one in the other.
+        class ReactionStream {
+        private:
+            std::default_random_engine engine{};
+            bool antithetic;
+        public:
+            ReactionStream(uint64_t seed, size_t reaction, bool antithetic): antithetic(antithetic) {
+                std::seed_seq sequence{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32), static_cast<uint32_t>(reaction)};
+                engine.seed(sequence);
+            }
+
+            // Unit rate exponential, -log(1 - u) or for the antithetic stream -log(u)
+            double_t exponential() {
+                auto u = std::uniform_real_distribution<double_t>(0.0, 1.0)(engine);
+                return antithetic ? -std::log(std::max(u, std::numeric_limits<double_t>::min())) : -std::log1p(-u);
+            }
+
+            double_t latency(const ReactionDelay& delay) {
+                auto u = std::uniform_real_distribution<double_t>(0.0, 1.0)(engine);
+                return delay_quantile(delay, antithetic ? 1 - u : u);
+            }
+        };
+
+        uint64_t derive_seed(uint64_t base, size_t sample, size_t scenario) {
+            std::seed_seq sequence{static_cast<uint32_t>(base), static_cast<uint32_t>(base >> 32),
+                                   static_cast<uint32_t>(sample), static_cast<uint32_t>(scenario)};
+            std::array<uint32_t, 2> words{};
+            sequence.generate(words.begin(), words.end());
+            return (static_cast<uint64_t>(words[0]) << 32) | words[1];
+        }
+
+        uint64_t base_seed(const VarianceReductionOptions& options) {
+            if (options.seed.has_value()) {
+                return options.seed.value();
+            }
+            std::random_device device{};
+            return (static_cast<uint64_t>(device()) << 32) | device();
+        }
+
+        // Computes the statistics of every sample on a pool of threads. Results are stored by sample
+        // index, so with a fixed seed they do not depend on the scheduling.
+        std::vector<std::vector<double_t>> run_samples(size_t samples, size_t threads, const std::function<std::vector<double_t>(size_t)>& sample) {
+            std::vector<std::vector<double_t>> results(samples);
+            std::atomic<size_t> next{0};
+            std::exception_ptr failure{};
+            std::mutex failure_mutex{};
+
+            auto jobs = threads == 0 ? std::max<size_t>(1, std::thread::hardware_concurrency()) : threads;
+            jobs = std::max<size_t>(1, std::min(jobs, samples));
+
+            {
+                std::vector<std::jthread> workers{};
+                for (size_t job = 0; job < jobs; ++job) {
+                    workers.emplace_back([&]() {
+                        for (auto i = next++; i < samples; i = next++) {
+                            try {
+                                results[i] = sample(i);
+                            } catch (...) {
+                                std::lock_guard lock{failure_mutex};
+                                failure = std::current_exception();
+                                next = samples;
+                            }
+                        }
+                    });
+                }
+            }
+
+            if (failure) {
+                std::rethrow_exception(failure);
+            }
+            return results;
+        }
+
+        double_t sample_variance(const std::vector<double_t>& values) {
+            if (values.size() < 2) {
+                return 0;
+            }
+            auto mean = std::accumulate(values.begin(), values.end(), 0.0) / static_cast<double_t>(values.size());
+            double_t sum{0};
+            for (auto value: values) {
+                sum += (value - mean) * (value - mean);
+            }
+            return sum / static_cast<double_t>(values.size() - 1);
+        }
+
+        EnsembleEstimate make_estimate(const std::vector<double_t>& values, double_t independent_variance, size_t simulations) {
+            auto samples = values.size();
+            auto mean = std::accumulate(values.begin(), values.end(), 0.0) / static_cast<double_t>(samples);
+            auto variance = sample_variance(values) / static_cast<double_t>(samples);
+
+            auto reduction = variance > 0 ? independent_variance / variance
+                    : independent_variance > 0 ? std::numeric_limits<double_t>::infinity() : 1.0;
+            return {mean, variance, reduction, samples, simulations};
+        }
+    }
+
+    // Modified next reaction method (Anderson 2007). Reaction k fires when its internal time, the
+    // integral of its propensity, reaches the next jump of a unit rate Poisson process drawn from
+    // the stream of k.
+    std::shared_ptr<SimulationTrajectory> Vessel::do_next_reaction_simulation(double_t end_time, uint64_t seed, bool antithetic, simulation_monitor& monitor) const {
+        ReactionNetwork network{*this};
+        auto n = network.reactions.size();
+
+        SimulationTrajectory trajectory{reactants};
+        trajectory.reserve(reserved_rows());
+        SimulationState state{reactants, 0};
+        auto amounts = network.initial_amounts();
+        trajectory.insert(0, amounts);
+
+        std::vector<ReactionStream> streams{};
+        std::vector<double_t> internal(n, 0.0);
+        std::vector<double_t> next_jump(n);
+        std::vector<double_t> propensities(n);
+        streams.reserve(n);
+        for (size_t r = 0; r < n; ++r) {
+            streams.emplace_back(seed, r, antithetic);
+            next_jump[r] = streams[r].exponential();
+            propensities[r] = network.propensity(r, amounts);
+        }
+
+        CompletionQueue pending{};
+        pending.reserve(reserved_in_flight());
+        auto& interventions = network.interventions;
+        size_t next_intervention{0};
+        double_t t{0};
+
+        while (t < end_time) {
+            size_t selected{n};
+            auto delay = std::numeric_limits<double_t>::infinity();
+            for (size_t r = 0; r < n; ++r) {
+                if (propensities[r] > 0) {
+                    auto candidate = (next_jump[r] - internal[r]) / propensities[r];
+                    if (candidate < delay) {
+                        delay = candidate;
+                        selected = r;
+                    }
+                }
+            }
+
+            auto intervention_time = next_intervention < interventions.size()
+                    ? interventions[next_intervention].time
+                    : std::numeric_limits<double_t>::infinity();
+            auto completion_time = pending.next_time();
+            auto event_time = std::min({t + delay, intervention_time, completion_time});
+            if (event_time > end_time) {
+                break;
+            }
+
+            // Every internal time advances with its propensity until the event
+            auto elapsed = std::max(0.0, event_time - t);
+            for (size_t r = 0; r < n; ++r) {
+                internal[r] += propensities[r] * elapsed;
+            }
+            t = std::max(t, event_time);
+
+            if (completion_time <= event_time) {
+                network.complete(pending.pop().reaction, amounts);
+            } else if (intervention_time <= event_time) {
+                while (next_intervention < interventions.size() && interventions[next_intervention].time == intervention_time) {
+                    network.apply(interventions[next_intervention++], amounts);
+                }
+            } else {
+                auto& reaction = network.reactions[selected];
+                if (network.can_fire(selected, amounts)) {
+                    if (reaction.delay.has_value()) {
+                        network.start(selected, amounts);
+                        pending.push(t + streams[selected].latency(reaction.delay.value()), selected);
+                    } else {
+                        network.fire(selected, amounts);
+                    }
+                }
+                internal[selected] = next_jump[selected];
+                next_jump[selected] += streams[selected].exponential();
+            }
+
+            for (size_t r = 0; r < n; ++r) {
+                propensities[r] = network.propensity(r, amounts);
+            }
+
+            trajectory.insert(t, amounts);
+
+            state.time = t;
+            for (size_t i = 0; i < amounts.size(); ++i) {
+                state.reactants[Symbol{i}].amount = amounts[i];
+            }
+            monitor.monitor(state);
+        }
+
+        record_run(trajectory.size(), pending.peak_size());
+        return std::make_shared<SimulationTrajectory>(std::move(trajectory));
+    }
+
+    EnsembleEstimate compare_scenarios(const Vessel& a, const Vessel& b, double_t end_time, size_t samples,
+                                       const TrajectoryStatistic& statistic, const VarianceReductionOptions& options) {
+        if (a.get_reactions().size() != b.get_reactions().size()) {
+            throw std::invalid_argument("Scenarios to compare must have the same reactions");
+        }
+        if (samples < 2) {
+            throw std::invalid_argument("At least two samples are needed to estimate a variance");
+        }
+
+        auto base = base_seed(options);
+        auto mode = options.mode;
+
+        // Every sample is [a, b] or for antithetic sampling [a, b, antithetic a, antithetic b]
+        auto results = run_samples(samples, options.threads, [&](size_t sample) {
+            auto seed_a = derive_seed(base, sample, 0);
+            auto seed_b = mode == VarianceReduction::independent ? derive_seed(base, sample, 1) : seed_a;
+
+            std::vector<double_t> values{
+                statistic(*a.do_next_reaction_simulation(end_time, seed_a)),
+                statistic(*b.do_next_reaction_simulation(end_time, seed_b))
+            };
+            if (mode == VarianceReduction::antithetic) {
+                values.push_back(statistic(*a.do_next_reaction_simulation(end_time, seed_a, true)));
+                values.push_back(statistic(*b.do_next_reaction_simulation(end_time, seed_b, true)));
+            }
+            return values;
+        });
+
+        std::vector<double_t> differences{}, values_a{}, values_b{};
+        for (auto& values: results) {
+            double_t difference{0};
+            for (size_t i = 0; i < values.size(); i += 2) {
+                values_a.push_back(values[i]);
+                values_b.push_back(values[i + 1]);
+                difference += values[i + 1] - values[i];
+            }
+            differences.push_back(difference / static_cast<double_t>(values.size() / 2));
+        }
+
+        // Independent runs would spend half of the simulations on each scenario
+        auto simulations = values_a.size() + values_b.size();
+        auto independent = (sample_variance(values_a) + sample_variance(values_b)) / (static_cast<double_t>(simulations) / 2.0);
+
+        return make_estimate(differences, independent, simulations);
+    }
+
+    EnsembleEstimate estimate_statistic(const Vessel& vessel, double_t end_time, size_t samples,
+                                        const TrajectoryStatistic& statistic, const VarianceReductionOptions& options) {
+        if (samples < 2) {
+            throw std::invalid_argument("At least two samples are needed to estimate a variance");
+        }
+
+        auto base = base_seed(options);
+        auto antithetic = options.mode == VarianceReduction::antithetic;
+
+        auto results = run_samples(samples, options.threads, [&](size_t sample) {
+            auto seed = derive_seed(base, sample, 0);
+
+            std::vector<double_t> values{statistic(*vessel.do_next_reaction_simulation(end_time, seed))};
+            if (antithetic) {
+                values.push_back(statistic(*vessel.do_next_reaction_simulation(end_time, seed, true)));
+            }
+            return values;
+        });
+
+        std::vector<double_t> means{}, values{};
+        for (auto& sample: results) {
+            means.push_back(std::accumulate(sample.begin(), sample.end(), 0.0) / static_cast<double_t>(sample.size()));
+            values.insert(values.end(), sample.begin(), sample.end());
+        }
+
+        auto independent = sample_variance(values) / static_cast<double_t>(values.size());
+        return make_estimate(means, independent, values.size());
+    }
+}
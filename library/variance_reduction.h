@@ -0,0 +1,40 @@
+#ifndef SP_EXAM_PROJECT_VARIANCE_REDUCTION_H
+#define SP_EXAM_PROJECT_VARIANCE_REDUCTION_H
+
+#include "simulation.h"
+
+namespace StochasticSimulation {
+
+    enum class VarianceReduction {
+        independent,            // plain Monte Carlo, as a reference
+        common_random_numbers,  // the runs of a pair of scenarios use the same random streams
+        antithetic              // as common_random_numbers, and every sample is followed by its antithetic sample
+    };
+
+    struct VarianceReductionOptions {
+        VarianceReduction mode{VarianceReduction::common_random_numbers};
+        size_t threads{0};              // 0 uses one thread per core
+        std::optional<uint64_t> seed{}; // makes the result reproducible
+    };
+
+    struct EnsembleEstimate {
+        double_t mean;
+        double_t variance;            // variance of the mean
+        double_t variance_reduction;  // variance of independent runs with as many simulations, divided by variance
+        size_t samples;
+        size_t simulations;
+    };
+
+    // Mean of statistic(b) - statistic(a). The scenarios are typically the same vessel with other rates,
+    // amounts or interventions, reaction i of a is paired with reaction i of b. Runs are made with the
+    // next reaction method, where each reaction draws from its own random stream, so with common random
+    // numbers the two runs of a sample only diverge where the scenarios differ.
+    EnsembleEstimate compare_scenarios(const Vessel& a, const Vessel& b, double_t end_time, size_t samples,
+                                       const TrajectoryStatistic& statistic, const VarianceReductionOptions& options = {});
+
+    // Mean of statistic over runs of one vessel, in antithetic mode every run is paired with its antithetic run
+    EnsembleEstimate estimate_statistic(const Vessel& vessel, double_t end_time, size_t samples,
+                                        const TrajectoryStatistic& statistic, const VarianceReductionOptions& options = {});
+}
+
+#endif //SP_EXAM_PROJECT_VARIANCE_REDUCTION_H
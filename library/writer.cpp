@@ -0,0 +1,189 @@
+#include <charconv>
+#include <stdexcept>
+#include "writer.h"
+
+namespace StochasticSimulation {
+
+    namespace {
+        void append_number(std::string& buffer, double_t value) {
+            char digits[32];
+            auto [end, error] = std::to_chars(std::begin(digits), std::end(digits), value);
+            buffer.append(digits, end);
+        }
+
+        void append_number(std::string& buffer, size_t value) {
+            char digits[24];
+            auto [end, error] = std::to_chars(std::begin(digits), std::end(digits), value);
+            buffer.append(digits, end);
+        }
+    }
+
+    TrajectoryWriter::TrajectoryWriter(std::string path, const TrajectoryWriterOptions& options):
+        path(std::move(path)),
+        options(options),
+        queue(options.queue_capacity)
+    {
+        buffer.reserve(options.buffer_bytes + 4096);
+        if (options.combined) {
+            combined_file.open(this->path, std::ios::binary | std::ios::trunc);
+            if (!combined_file) {
+                throw std::runtime_error("Could not open " + this->path + " for writing");
+            }
+        }
+        thread = std::thread{&TrajectoryWriter::consume, this};
+    }
+
+    TrajectoryWriter::~TrajectoryWriter() {
+        try {
+            close();
+        } catch (...) {
+            // A destructor cannot report the failure, call close() to see it
+        }
+    }
+
+    void TrajectoryWriter::submit(size_t run, std::shared_ptr<const SimulationTrajectory> trajectory) {
+        // Counted before checking closing, so the writer keeps taking runs until this one is pushed
+        submitting.fetch_add(1);
+        if (closing.load()) {
+            submitting.fetch_sub(1);
+            pushed.fetch_add(1);
+            pushed.notify_one();
+            throw std::logic_error("Runs cannot be submitted to a closed writer");
+        }
+
+        QueuedRun queued{run, std::move(trajectory)};
+        while (!queue.try_push(queued)) {
+            // Full, wait for the writer to take a run
+            auto seen = popped.load();
+            if (queue.try_push(queued)) {
+                break;
+            }
+            popped.wait(seen);
+        }
+        // Bumped before the count drops, so the writer cannot see no submit in flight and miss this run,
+        // and after it, so a writer waiting for the count wakes up
+        pushed.fetch_add(1);
+        submitting.fetch_sub(1);
+        pushed.fetch_add(1);
+        pushed.notify_one();
+    }
+
+    void TrajectoryWriter::close() {
+        std::lock_guard lock{close_mutex};
+        if (closed) {
+            return;
+        }
+        closed = true;
+        closing.store(true);
+        pushed.fetch_add(1);
+        pushed.notify_one();
+        thread.join();
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    void TrajectoryWriter::consume() {
+        while (true) {
+            auto seen = pushed.load();
+            if (auto queued = queue.try_pop()) {
+                popped.fetch_add(1);
+                popped.notify_all();
+
+                // After a failed write the runs are still taken off the queue, so producers never block
+                if (!error) {
+                    try {
+                        write(queued.value());
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                }
+                continue;
+            }
+
+            // A submit racing close is still written. Once none is in flight every run is counted in
+            // pushed, so an unchanged count means the queue was empty when it was last checked.
+            if (closing.load() && submitting.load() == 0) {
+                if (pushed.load() == seen) {
+                    break;
+                }
+                continue;
+            }
+            pushed.wait(seen);
+        }
+
+        if (!error && options.combined) {
+            try {
+                flush(combined_file);
+                combined_file.close();
+                if (combined_file.fail()) {
+                    throw std::runtime_error("Could not write " + path);
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+    }
+
+    void TrajectoryWriter::flush(std::ofstream& file) {
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+        if (!file) {
+            throw std::runtime_error("Could not write trajectories to " + path);
+        }
+    }
+
+    void TrajectoryWriter::write(const QueuedRun& queued) {
+        auto& trajectory = *queued.trajectory;
+
+        std::ofstream run_file{};
+        if (!options.combined) {
+            auto run_path = path + "_" + std::to_string(queued.run) + ".csv";
+            run_file.open(run_path, std::ios::binary | std::ios::trunc);
+            if (!run_file) {
+                throw std::runtime_error("Could not open " + run_path + " for writing");
+            }
+        }
+        auto& file = options.combined ? combined_file : run_file;
+
+        // Same layout as write_csv, the combined file starts every row with the run
+        if (!options.combined || !header_written) {
+            if (options.combined) {
+                buffer += "run,";
+            }
+            for (auto& reactant: trajectory.species()) {
+                buffer += reactant.second.name;
+                buffer += ',';
+            }
+            buffer += "time\n";
+            header_written = true;
+        }
+
+        for (auto point: trajectory) {
+            if (options.combined) {
+                append_number(buffer, queued.run);
+                buffer += ',';
+            }
+            for (auto amount: point.amounts) {
+                append_number(buffer, amount);
+                buffer += ',';
+            }
+            append_number(buffer, point.time);
+            buffer += '\n';
+
+            if (buffer.size() >= options.buffer_bytes) {
+                flush(file);
+            }
+        }
+
+        if (!options.combined) {
+            flush(file);
+            run_file.close();
+            if (run_file.fail()) {
+                throw std::runtime_error("Could not write run " + std::to_string(queued.run) + " to " + path);
+            }
+        }
+        runs_written.fetch_add(1);
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef SP_EXAM_PROJECT_WRITER_H
+#define SP_EXAM_PROJECT_WRITER_H
+
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include "simulation.h"
+#include "mpsc_queue.h"
+
+namespace StochasticSimulation {
+
+    struct TrajectoryWriterOptions {
+        bool combined{false};            // one file with a run column instead of one file per run
+        size_t queue_capacity{64};       // runs waiting to be written, submitting waits while it is full
+        size_t buffer_bytes{1 << 20};    // text gathered before every write
+    };
+
+    // Writes trajectories as csv on its own thread while the simulations continue. Runs are handed over
+    // through a bounded lock-free queue, so at most queue_capacity finished runs wait in memory.
+    // Per-run files are named <path>_<run>.csv, a combined file is written to path.
+    class TrajectoryWriter {
+    private:
+        struct QueuedRun {
+            size_t run{0};
+            std::shared_ptr<const SimulationTrajectory> trajectory{};
+        };
+
+        std::string path;
+        TrajectoryWriterOptions options;
+        MpscQueue<QueuedRun> queue;
+        std::atomic<size_t> pushed{0};      // bumped on every change the writer thread waits for
+        std::atomic<size_t> popped{0};
+        std::atomic<size_t> runs_written{0};
+        std::atomic<size_t> submitting{0};  // submits that passed the closing check and have not pushed yet
+        std::atomic<bool> closing{false};
+        std::exception_ptr error{};
+        std::mutex close_mutex{};
+        bool closed{false};                 // guarded by close_mutex
+
+        std::string buffer{};
+        std::ofstream combined_file{};
+        bool header_written{false};
+        std::thread thread;
+
+        void consume();
+        void write(const QueuedRun& queued);
+        void flush(std::ofstream& file);
+    public:
+        explicit TrajectoryWriter(std::string path, const TrajectoryWriterOptions& options = {});
+        ~TrajectoryWriter();
+
+        TrajectoryWriter(const TrajectoryWriter&) = delete;
+        TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+        // Safe to call from any number of threads, waits while the queue is full
+        void submit(size_t run, std::shared_ptr<const SimulationTrajectory> trajectory);
+
+        // Waits until every submitted run is written, a failed write is thrown here. Safe to call from
+        // several threads, the failure is thrown to the first caller only.
+        void close();
+
+        [[nodiscard]] size_t written() const {
+            return runs_written.load();
+        }
+    };
+}
+
+#endif //SP_EXAM_PROJECT_WRITER_H
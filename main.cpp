@@ -2,6 +2,16 @@
 #include "library/simulation.h"
 #include <chrono>
 #include "vessels.h"
+#include "library/metapopulation.h"
+#include "library/variance_reduction.h"
+#include "library/rare_event.h"
+#include "library/analysis.h"
+#include "library/cache.h"
+#include "library/codec.h"
+#include "library/model.h"
+#include "library/writer.h"
+#include "library/stationary.h"
+#include <filesystem>
 
 using namespace StochasticSimulation;
 
@@ -10,11 +20,16 @@ class hospitalized_monitor: public simulation_monitor {
 private:
     double_t hospitalized_acc{0.0};
     double_t last_time{0.0};
+    std::optional<Symbol> hospitalized{};
 public:
     size_t max_hospitalized{0};
 
     void monitor(SimulationState &state) override {
-        auto currently_hospitalized = state.reactants.get("H").amount;
+        // Resolve the symbol once, afterwards every lookup is a plain index
+        if (!hospitalized.has_value()) {
+            hospitalized = state.reactants.symbol("H");
+        }
+        auto currently_hospitalized = state.reactants[hospitalized.value()].amount;
 
         if (currently_hospitalized > max_hospitalized) {
             max_hospitalized = currently_hospitalized;
@@ -67,6 +82,209 @@ void simulate_covid_multiple() {
     std::cout << "Turn it into a graph using python ./draw_graph.py covid covid_output_multiple.csv" << std::endl;
 }
 
+void simulate_covid_multiple_to_disk() {
+    std::cout << "Simulating covid19 example 100 times, writing every run to covid_output_run_<run>.csv while simulating" << std::endl;
+    Vessel covid_vessel = seihr(10000);
+
+    TrajectoryWriter writer{"covid_output_run", {.queue_capacity = 16}};
+    auto trajectories = covid_vessel.do_multiple_simulations(110, 100, {.writer = &writer});
+    writer.close();
+
+    std::cout << writer.written() << " of " << trajectories.size() << " runs written" << std::endl;
+}
+
+void simulate_covid_pinned() {
+    std::cout << "Simulating covid19 example 100 times with the workers pinned to the NUMA nodes" << std::endl;
+    Vessel covid_vessel = seihr(10000);
+
+    PlacementReport placement{};
+    auto t0 = std::chrono::high_resolution_clock::now();
+    auto trajectories = covid_vessel.do_multiple_simulations(110, 100, {.placement = ThreadPlacement::numa_nodes, .placement_report = &placement});
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    std::cout << placement;
+    std::cout << trajectories.size() << " runs in " << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << " ms" << std::endl;
+}
+
+void simulate_covid_cached() {
+    std::cout << "Simulating covid19 example 100 times in worker processes, twice with a cache" << std::endl;
+    Vessel covid_vessel = seihr(10000);
+    EnsembleCache cache{"ensemble_cache", 64 << 20};
+
+    for (int i = 0; i < 2; ++i) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        auto statistics = covid_vessel.do_multiple_process_simulations(110, 100, {.seed = 42, .cache = &cache});
+        auto t1 = std::chrono::high_resolution_clock::now();
+
+        auto hospitalized = statistics.species.symbol("H");
+        double_t peak{0};
+        for (size_t point = 0; point < statistics.times.size(); ++point) {
+            peak = std::max(peak, statistics.mean[point * statistics.species.size() + hospitalized.id]);
+        }
+        std::cout << "Peak of the mean hospitalized " << peak << " from " << statistics.runs << " runs in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << " ms" << std::endl;
+        if (!statistics.complete()) {
+            std::cout << statistics.requested - statistics.runs << " runs were lost to crashed workers" << std::endl;
+        }
+    }
+    std::cout << "Cache size: " << cache.size() << " bytes" << std::endl;
+}
+
+void simulate_covid_compressed() {
+    std::cout << "Simulating covid19 example while compressing the trajectory to covid_output.sstc" << std::endl;
+    Vessel covid_vessel = seihr(10000);
+
+    // Times are kept to a microsecond, the csv file keeps 6 significant digits
+    TrajectoryEncoder encoder{"covid_output.sstc", covid_vessel.get_reactants(), {.time_resolution = 1e-6}};
+    compressing_simulation_monitor monitor{encoder};
+    auto trajectory = covid_vessel.do_simulation(100, monitor);
+    encoder.finish();
+    trajectory->write_csv("covid_output.csv");
+
+    auto compressed = std::filesystem::file_size("covid_output.sstc");
+    auto csv = std::filesystem::file_size("covid_output.csv");
+    std::cout << trajectory->size() << " rows, csv " << csv << " bytes, compressed " << compressed << " bytes ("
+              << static_cast<double_t>(csv) / static_cast<double_t>(compressed) << "x smaller)" << std::endl;
+
+    TrajectoryArchive archive{"covid_output.sstc"};
+    auto hospitalized = archive.species().symbol("H");
+    auto window = archive.read(50, 60);
+    std::cout << "Hospitalized at day 55 from the archive: " << window.value_at(55, hospitalized)
+              << ", from the simulation: " << trajectory->value_at(55, hospitalized) << std::endl;
+}
+
+void simulate_covid_model(const std::string& path = "models/seihr.model") {
+    std::cout << "Simulating covid19 example loaded from " << path << std::endl;
+    Vessel covid_vessel = load_model(path);
+    std::cout << covid_vessel << std::endl;
+
+    auto trajectory = covid_vessel.do_simulation(100);
+    std::cout << "Writing trajectory to csv file at covid_output_model.csv" << std::endl;
+    trajectory->write_csv("covid_output_model.csv");
+}
+
+void simulate_covid_sequential() {
+    std::cout << "Simulating covid19 example until the mean peak of hospitalized is known within 5%" << std::endl;
+    Vessel covid_vessel = seihr(10000);
+
+    TrajectoryStatistic peak_hospitalized = [](const SimulationTrajectory& trajectory) {
+        auto hospitalized = trajectory.species().symbol("H");
+        double_t peak{0};
+        for (auto point: trajectory) {
+            peak = std::max(peak, point[hospitalized]);
+        }
+        return peak;
+    };
+
+    auto estimate = covid_vessel.do_sequential_simulations(120, peak_hospitalized, {.half_width = 0.05, .relative = true, .max_runs = 1000});
+
+    std::cout << "Peak hospitalized: " << estimate.mean << " +- " << estimate.half_width
+              << " after " << estimate.runs << " runs" << (estimate.converged ? "" : " (not converged)") << std::endl;
+}
+
+void simulate_covid_hospital_capacity() {
+    std::cout << "Estimating the probability that more than 10 are hospitalized at once" << std::endl;
+    Vessel covid_vessel = seihr(10000);
+    auto hospitalized = covid_vessel.get_reactants().symbol("H");
+
+    EventScore score = [hospitalized](const TrajectoryPoint& point) {
+        return point[hospitalized];
+    };
+
+    auto splitting = estimate_splitting(covid_vessel, 120, score, 11, {.levels = {3, 5, 7, 9}, .trajectories = 200});
+    std::cout << "Splitting: " << splitting.probability << " +- " << std::sqrt(splitting.variance)
+              << " using " << splitting.events << " events" << std::endl;
+
+    // Hospitalization (reaction 3) made more likely and discharge (reaction 4) less likely
+    auto weighted = estimate_weighted_ssa(covid_vessel, 120, score, 11, {.biases = {1, 1, 1, 3, 0.5}, .runs = 2000});
+    std::cout << "Weighted SSA: " << weighted.probability << " +- " << std::sqrt(weighted.variance)
+              << " using " << weighted.events << " events" << std::endl;
+}
+
+void simulate_covid_regions() {
+    std::cout << "Simulating covid19 example in 4 regions connected in a ring" << std::endl;
+    Metapopulation regions{};
+
+    for (auto i = 0; i < 4; ++i) {
+        regions.add_compartment("region" + std::to_string(i), seihr(10000));
+    }
+    for (size_t i = 0; i < regions.size(); ++i) {
+        for (auto species: {"S", "E", "I", "R"}) {
+            regions.connect(i, (i + 1) % regions.size(), species, 0.01);
+        }
+    }
+
+    auto trajectories = regions.do_simulation(120);
+
+    for (size_t i = 0; i < trajectories.size(); ++i) {
+        std::cout << "Writing " << regions.name(i) << " to covid_" << regions.name(i) << ".csv" << std::endl;
+        trajectories[i]->write_csv("covid_" + regions.name(i) + ".csv");
+    }
+}
+
+void simulate_covid_until_hospitalized() {
+    std::cout << "Simulating covid19 example until someone is hospitalized" << std::endl;
+    Vessel covid_vessel = seihr(10000);
+    auto hospitalized = covid_vessel.get_reactants().symbol("H");
+
+    size_t events{0};
+    for (auto state: covid_vessel.simulate(120)) {
+        events++;
+        if (state[hospitalized] > 0) {
+            std::cout << "First hospitalization at time " << state.time << " after " << events << " events" << std::endl;
+            return;
+        }
+    }
+    std::cout << "Nobody was hospitalized" << std::endl;
+}
+
+void simulate_covid_lockdown() {
+    std::cout << "Simulating covid19 example with a lockdown at day 30 lifted at day 90" << std::endl;
+    Vessel covid_vessel = seihr(10000);
+
+    // Reaction 0 is the infection S + I -> E + I
+    auto beta = covid_vessel.get_reactions()[0].rate;
+    covid_vessel.schedule_rate(30, 0, beta * 0.3);
+    covid_vessel.schedule_rate(90, 0, beta);
+    covid_vessel.schedule_amount(90, "I", 10);
+
+    hospitalized_monitor monitor{};
+    auto trajectory = covid_vessel.do_simulation(180, monitor);
+
+    std::cout << "Max hospitalized: " << monitor.max_hospitalized << std::endl;
+    std::cout << "Writing trajectory to csv file at covid_lockdown_output.csv" << std::endl;
+    trajectory->write_csv("covid_lockdown_output.csv");
+}
+
+void simulate_covid_delayed() {
+    std::cout << "Simulating covid19 example with the incubation period as a delay" << std::endl;
+    Vessel covid_vessel = seihr_delayed(10000);
+
+    hospitalized_monitor monitor{};
+    auto trajectory = covid_vessel.do_simulation(120, monitor);
+
+    std::cout << "Max hospitalized: " << monitor.max_hospitalized << std::endl;
+    std::cout << "Writing trajectory to csv file at covid_delayed_output.csv" << std::endl;
+    trajectory->write_csv("covid_delayed_output.csv");
+}
+
+void simulate_covid_lockdown_effect() {
+    std::cout << "Estimating the effect of a lockdown at day 20 on the recovered at day 60" << std::endl;
+    Vessel without = seihr(10000);
+    Vessel with = seihr(10000);
+    with.schedule_rate(20, 0, with.get_reactions()[0].rate * 0.7);
+
+    TrajectoryStatistic recovered = [](const SimulationTrajectory& trajectory) {
+        return trajectory.value_at(60, "R");
+    };
+
+    for (auto mode: {VarianceReduction::independent, VarianceReduction::common_random_numbers, VarianceReduction::antithetic}) {
+        auto estimate = compare_scenarios(without, with, 60, 100, recovered, {mode});
+        std::cout << "Difference: " << estimate.mean << " +- " << std::sqrt(estimate.variance)
+                  << " from " << estimate.simulations << " simulations, variance reduction " << estimate.variance_reduction << std::endl;
+    }
+}
+
 void simulate_introduction() {
     std::cout << "Simulating introduction example" << std::endl;
     Vessel introduction_vessel = introduction(25, 50, 1, 0.001);
@@ -93,6 +311,17 @@ void simulate_circadian() {
     trajectory->write_csv("circadian_output.csv");
 }
 
+void simulate_circadian_downsampled() {
+    std::cout << "Simulating circadian rhythm example for 1000 hours, writing 2000 points per species for plotting" << std::endl;
+    Vessel oscillator = circadian_oscillator();
+
+    auto trajectory = oscillator.do_simulation(1000);
+
+    std::cout << "Writing csv file with " << trajectory->downsampled_rows({Downsampling::lttb, 2000}).size()
+              << " of " << trajectory->size() << " rows..." << std::endl;
+    trajectory->write_csv("circadian_output.csv", {Downsampling::lttb, 2000});
+}
+
 void simulate_circadian2() {
     std::cout << "Simulating circadian rhythm alternative example..." << std::endl;
     Vessel oscillator = circadian_oscillator2();
@@ -106,6 +335,48 @@ void simulate_circadian2() {
     trajectory->write_csv("circadian2_output.csv");
 }
 
+void analyze_circadian_stationary() {
+    std::cout << "Stationary distribution of the circadian oscillator from 8 runs of 10000 hours" << std::endl;
+    StationaryOptions options{};
+    options.burn_in = 100;
+    options.bin_width = 10;
+    options.bins = 300;
+    options.max_lag = 100;
+
+    auto stationary = collect_stationary(circadian_oscillator(), 10000, {"A", "R"}, options, 8);
+
+    for (auto name: {"A", "R"}) {
+        auto& moments = stationary[name].moments;
+        auto correlation = stationary[name].autocorrelation.autocorrelation();
+        std::cout << name << ": mean " << moments.mean() << ", standard deviation " << std::sqrt(moments.variance())
+                  << ", range [" << moments.min() << ", " << moments.max() << "]"
+                  << ", autocorrelation after 10, 24 and 50 hours " << correlation[10] << ", " << correlation[24] << ", " << correlation[50] << std::endl;
+    }
+
+    std::ofstream file{"circadian_stationary.csv"};
+    file << "amount,A,R\n";
+    auto& a = stationary["A"].histogram;
+    auto& r = stationary["R"].histogram;
+    for (size_t bin = 0; bin < a.bins(); ++bin) {
+        file << a.bin_start(bin) << ',' << a.probability(bin) << ',' << r.probability(bin) << '\n';
+    }
+}
+
+void analyze_circadian() {
+    std::cout << "Static analysis of the circadian oscillator" << std::endl;
+    std::cout << NetworkAnalysis{circadian_oscillator()};
+}
+
+void simulate_circadian_ode() {
+    std::cout << "Solving circadian rhythm example as reaction rate equations..." << std::endl;
+    Vessel oscillator = circadian_oscillator();
+
+    auto trajectory = oscillator.do_ode_simulation(110, {.method = OdeMethod::rosenbrock});
+
+    std::cout << "Writing csv file..." << std::endl;
+    trajectory->write_csv("circadian_ode_output.csv");
+}
+
 void benchmark() {
     std::cout << "Benchmarking with circadian rhythm example (max_time=100)" << std::endl;
 
@@ -134,15 +405,52 @@ void benchmark() {
     }
     auto mean_time2 = time_acc2 / runs;
     std::cout << "Simulation 2 mean time (nanoseconds): " << mean_time2 << std::endl;
+
+    std::cout << "Benchmarking the engines with a generated network of 20000 reactions (max_time=0.2)" << std::endl;
+
+    Vessel large = random_network(2000, 20000);
+    std::vector<std::pair<std::string, SsaEngine>> engines{
+        {"Direct method", SsaEngine::direct},
+        {"Logarithmic direct method", SsaEngine::logarithmic_direct},
+        {"Composition-rejection", SsaEngine::composition_rejection}
+    };
+
+    for (auto& [name, selection]: engines) {
+        size_t events{0};
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for ([[maybe_unused]] const auto& point: large.simulate(0.2, selection)) {
+            events++;
+        }
+        auto t1 = std::chrono::high_resolution_clock::now();
+
+        auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(t1-t0).count();
+        std::cout << name << " time per event (nanoseconds): " << time / events << std::endl;
+    }
 }
 
 int main() {
 //    simulate_covid();
 //    simulate_covid_multiple();
+//    simulate_covid_multiple_to_disk();
+//    simulate_covid_pinned();
+//    simulate_covid_cached();
+//    simulate_covid_compressed();
+//    simulate_covid_model();
+//    simulate_covid_sequential();
+//    simulate_covid_hospital_capacity();
+//    simulate_covid_regions();
+//    simulate_covid_until_hospitalized();
+//    simulate_covid_lockdown();
+//    simulate_covid_delayed();
+//    simulate_covid_lockdown_effect();
 
 //    simulate_introduction();
     simulate_circadian();
+//    simulate_circadian_downsampled();
 //    simulate_circadian2();
+//    simulate_circadian_ode();
+//    analyze_circadian();
+//    analyze_circadian_stationary();
 
 //    benchmark();
 }
@@ -0,0 +1,183 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include "../library/simulation.h"
+#include "../library/stepper.h"
+#include "../vessels.h"
+
+using namespace StochasticSimulation;
+
+// Every allocation of this program is counted, the engines must not make any once warmed up. All forms
+// of new and delete are replaced, the nothrow forms of the standard library call these.
+std::atomic<size_t> allocations{0};
+
+namespace {
+    void* counted_allocation(size_t size, size_t alignment) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        size = size == 0 ? 1 : size;
+        // aligned_alloc needs a size that is a multiple of the alignment
+        auto* pointer = alignment <= alignof(std::max_align_t)
+                ? std::malloc(size)
+                : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+        if (pointer == nullptr) {
+            throw std::bad_alloc{};
+        }
+        return pointer;
+    }
+}
+
+void* operator new(size_t size) {
+    return counted_allocation(size, alignof(std::max_align_t));
+}
+
+void* operator new[](size_t size) {
+    return counted_allocation(size, alignof(std::max_align_t));
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return counted_allocation(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return counted_allocation(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+// Counts the allocations made from the warm_up'th event the monitor sees until the last
+class allocation_monitor: public simulation_monitor {
+private:
+    size_t warm_up;
+    size_t before{0};
+public:
+    size_t events{0};
+    size_t counted{0};
+
+    explicit allocation_monitor(size_t warm_up): warm_up(warm_up) {}
+
+    void monitor(SimulationState&) override {
+        events++;
+        if (events == warm_up) {
+            before = allocations.load();
+        } else if (events > warm_up) {
+            counted = allocations.load() - before;
+        }
+    }
+};
+
+struct AllocationCheck {
+    bool passed{true};
+
+    void report(const std::string& name, size_t counted, size_t events) {
+        std::cout << name << ": " << counted << " allocations in " << events << " events" << std::endl;
+        passed = passed && counted == 0;
+    }
+
+    // The first run sizes the buffers of the vessel, the second is counted after its warm-up events
+    void run(const std::string& name, size_t warm_up, const std::function<void(simulation_monitor&)>& simulate) {
+        simulate(EMPTY_SIMULATION_MONITOR);
+        allocation_monitor monitor{warm_up};
+        simulate(monitor);
+        if (monitor.events <= warm_up) {
+            std::cout << name << ": only " << monitor.events << " events, the check needs more than " << warm_up << std::endl;
+            passed = false;
+            return;
+        }
+        report(name, monitor.counted, monitor.events - warm_up);
+    }
+};
+
+int main() {
+    AllocationCheck check{};
+
+    std::vector<std::tuple<std::string, Vessel, double_t>> vessels{};
+    vessels.emplace_back("seihr", seihr(10000), 100);
+    vessels.emplace_back("seihr delayed", seihr_delayed(10000), 100);
+    vessels.emplace_back("circadian", circadian_oscillator(), 100);
+    vessels.emplace_back("random", random_network(200, 2000), 0.5);
+
+    std::vector<std::pair<std::string, SsaEngine>> engines{
+        {"direct", SsaEngine::direct},
+        {"logarithmic direct", SsaEngine::logarithmic_direct},
+        {"composition-rejection", SsaEngine::composition_rejection}
+    };
+
+    for (auto& [vessel_name, vessel, end_time]: vessels) {
+        for (auto& [engine_name, selection]: engines) {
+            DirectMethodStepper stepper{ReactionNetwork{vessel}, std::default_random_engine{42}, selection};
+            for (size_t i = 0; i < 10000 && stepper.step(1e9); ++i) {}
+
+            auto before = allocations.load();
+            size_t steps{0};
+            for (; steps < 100000 && stepper.step(1e9); ++steps) {}
+            check.report(vessel_name + ", " + engine_name + " stepper", allocations.load() - before, steps);
+
+            check.run(vessel_name + ", " + engine_name + " do_simulation", 1000, [&, selection = selection, end_time = end_time](simulation_monitor& monitor) {
+                vessel.do_simulation(end_time, selection, monitor);
+            });
+        }
+
+        // Every event scans all reactions, a shorter run is enough
+        check.run(vessel_name + ", next reaction", 1000, [&, end_time = end_time](simulation_monitor& monitor) {
+            vessel.do_next_reaction_simulation(end_time / 2, 42, false, monitor);
+        });
+    }
+
+    auto covid = seihr(10000);
+    check.run("seihr, hybrid", 100, [&](simulation_monitor& monitor) {
+        covid.do_hybrid_simulation(100, {}, monitor);
+    });
+    check.run("seihr, ode", 10, [&](simulation_monitor& monitor) {
+        covid.do_ode_simulation(100, {}, monitor);
+    });
+
+    auto oscillator = circadian_oscillator();
+    check.run("circadian, hybrid", 100, [&](simulation_monitor& monitor) {
+        oscillator.do_hybrid_simulation(100, {}, monitor);
+    });
+    check.run("circadian, slow-scale", 100, [&](simulation_monitor& monitor) {
+        oscillator.do_slow_scale_simulation(30, {}, monitor);
+    });
+    check.run("circadian, ode", 100, [&](simulation_monitor& monitor) {
+        oscillator.do_ode_simulation(100, {}, monitor);
+    });
+    check.run("circadian, ode rosenbrock", 100, [&](simulation_monitor& monitor) {
+        oscillator.do_ode_simulation(100, {.method = OdeMethod::rosenbrock}, monitor);
+    });
+
+    std::cout << (check.passed ? "No allocations while stepping" : "Allocations while stepping") << std::endl;
+    return check.passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,133 @@
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include "../library/stationary.h"
+
+using namespace StochasticSimulation;
+
+struct StationaryCheck {
+    bool passed{true};
+
+    void expect(const std::string& name, double_t value, double_t expected, double_t tolerance) {
+        auto ok = std::abs(value - expected) <= tolerance;
+        std::cout << name << ": " << value << ", expected " << expected << " +- " << tolerance << (ok ? "" : "  FAILED") << std::endl;
+        passed = passed && ok;
+    }
+};
+
+// Birth-death process: env -> A at rate birth, A -> env at rate death per molecule. The stationary law of
+// A is Poisson with mean birth / death, and its autocorrelation after time t is exp(-death * t).
+void check_birth_death(StationaryCheck& check) {
+    constexpr double_t birth = 20;
+    constexpr double_t death = 1;
+    constexpr auto mean = birth / death;
+
+    auto vessel = Vessel{};
+    auto env = vessel.environment();
+    auto a = vessel("A", 0);
+    vessel(env >>= a, birth);
+    vessel(a >>= env, death);
+
+    StationaryOptions options{};
+    options.burn_in = 20;
+    options.bins = 60;
+    options.sample_interval = 0.1;
+    options.max_lag = 30;
+    options.seed = 42;
+    auto stationary = collect_stationary(vessel, 2000, {"A"}, options, 4);
+    auto& statistics = stationary["A"];
+
+    check.expect("birth-death mean", statistics.moments.mean(), mean, 0.3);
+    check.expect("birth-death variance", statistics.moments.variance(), mean, 1.5);
+
+    // Total variation distance to the Poisson law
+    auto distance = statistics.histogram.probability_below() + statistics.histogram.probability_above();
+    for (size_t bin = 0; bin < statistics.histogram.bins(); ++bin) {
+        auto k = static_cast<double_t>(bin);
+        auto poisson = std::exp(k * std::log(mean) - mean - std::lgamma(k + 1));
+        distance += std::abs(statistics.histogram.probability(bin) - poisson);
+    }
+    check.expect("birth-death distance to Poisson", distance / 2, 0, 0.02);
+
+    auto correlation = statistics.autocorrelation.autocorrelation();
+    auto worst = 0.0;
+    for (size_t k = 0; k <= options.max_lag; ++k) {
+        auto expected = std::exp(-death * options.sample_interval * static_cast<double_t>(k));
+        worst = std::max(worst, std::abs(correlation[k] - expected));
+    }
+    check.expect("birth-death largest autocorrelation error", worst, 0, 0.08);
+
+    // Replicas are seeded from the seed and their number, so the same seed gives the same result
+    auto again = collect_stationary(vessel, 2000, {"A"}, options, 4);
+    check.expect("birth-death mean with the same seed", again["A"].moments.mean(), statistics.moments.mean(), 0);
+}
+
+// AR(1) series x_t = phi * x_t-1 + noise, checked against the direct sum of the lagged products. Series of
+// lengths that are not multiples of the block size, an unfinished series and merging are covered.
+void check_ar1(StationaryCheck& check) {
+    constexpr size_t max_lag = 40;
+    constexpr double_t phi = 0.8;
+
+    std::default_random_engine engine{7};
+    std::normal_distribution<double_t> noise{3, 1};
+    std::vector<std::vector<double_t>> series{};
+    for (size_t length: {1000, 2345, 177, 5000}) {
+        std::vector<double_t> x{};
+        auto value = 15.0;
+        for (size_t t = 0; t < length; ++t) {
+            value = phi * value + noise(engine);
+            x.push_back(value);
+        }
+        series.push_back(std::move(x));
+    }
+
+    // The first three series go into one collector, the last is left unfinished in another and merged
+    BlockAutocorrelation collected{max_lag}, unfinished{max_lag};
+    for (size_t s = 0; s + 1 < series.size(); ++s) {
+        for (auto x: series[s]) {
+            collected.add(x);
+        }
+        collected.end_series();
+    }
+    for (auto x: series.back()) {
+        unfinished.add(x);
+    }
+    collected.merge(unfinished);
+    auto correlation = collected.autocorrelation();
+
+    auto sum = 0.0;
+    size_t count{0};
+    std::vector<double_t> products(max_lag + 1, 0.0), pairs(max_lag + 1, 0.0);
+    for (auto& x: series) {
+        for (size_t t = 0; t < x.size(); ++t) {
+            sum += x[t];
+            count++;
+            for (size_t k = 0; k <= max_lag && k <= t; ++k) {
+                products[k] += x[t] * x[t - k];
+                pairs[k]++;
+            }
+        }
+    }
+    auto mean = sum / static_cast<double_t>(count);
+    auto variance = products[0] / pairs[0] - mean * mean;
+
+    auto direct_error = 0.0;
+    auto model_error = 0.0;
+    for (size_t k = 0; k <= max_lag; ++k) {
+        auto direct = (products[k] / pairs[k] - mean * mean) / variance;
+        direct_error = std::max(direct_error, std::abs(correlation[k] - direct));
+        model_error = std::max(model_error, std::abs(correlation[k] - std::pow(phi, static_cast<double_t>(k))));
+    }
+    check.expect("AR(1) largest difference to the direct sum", direct_error, 0, 1e-9);
+    check.expect("AR(1) largest difference to phi^k", model_error, 0, 0.15);
+    check.expect("AR(1) samples", static_cast<double_t>(collected.samples()), static_cast<double_t>(count), 0);
+}
+
+int main() {
+    StationaryCheck check{};
+    check_birth_death(check);
+    check_ar1(check);
+
+    std::cout << (check.passed ? "Stationary statistics match the known answers" : "Stationary statistics are off") << std::endl;
+    return check.passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
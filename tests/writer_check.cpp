@@ -0,0 +1,68 @@
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include "../library/writer.h"
+#include "../vessels.h"
+
+using namespace StochasticSimulation;
+
+// Producers submit while the writer is closed from other threads. Every run a submit accepted must be
+// written, and neither the producers nor close may block forever.
+bool close_while_submitting(const std::string& name, size_t queue_capacity, const std::filesystem::path& directory,
+                            const std::shared_ptr<const SimulationTrajectory>& trajectory) {
+    constexpr size_t rounds = 200;
+    constexpr size_t producers = 4;
+    constexpr size_t runs_per_producer = 25;
+
+    for (size_t round = 0; round < rounds; ++round) {
+        std::atomic<size_t> accepted{0};
+        TrajectoryWriter writer{(directory / "combined.csv").string(), {.combined = true, .queue_capacity = queue_capacity, .buffer_bytes = 1 << 16}};
+
+        std::vector<std::thread> threads{};
+        for (size_t producer = 0; producer < producers; ++producer) {
+            threads.emplace_back([&, producer]() {
+                for (size_t i = 0; i < runs_per_producer; ++i) {
+                    try {
+                        writer.submit(producer * runs_per_producer + i, trajectory);
+                        accepted++;
+                    } catch (const std::logic_error&) {
+                        // Closed, the run is rejected and not counted
+                    }
+                }
+            });
+        }
+
+        // Close at a different point of the submits every round, from two threads at once
+        std::this_thread::sleep_for(std::chrono::microseconds(round * 5));
+        std::thread second_close{[&writer]() { writer.close(); }};
+        writer.close();
+        second_close.join();
+        for (auto& thread: threads) {
+            thread.join();
+        }
+
+        if (writer.written() != accepted.load()) {
+            std::cout << name << ": round " << round << " accepted " << accepted.load() << " runs but wrote " << writer.written() << std::endl;
+            return false;
+        }
+    }
+    std::cout << name << ": every accepted run written in " << rounds << " rounds" << std::endl;
+    return true;
+}
+
+int main() {
+    auto directory = std::filesystem::temp_directory_path() / "writer_check";
+    std::filesystem::create_directories(directory);
+
+    std::shared_ptr<const SimulationTrajectory> trajectory = seihr(100).do_simulation(1);
+
+    // A queue of one is full nearly all the time, a large queue is almost never full
+    auto passed = close_while_submitting("full queue", 1, directory, trajectory);
+    passed = close_while_submitting("empty queue", 1024, directory, trajectory) && passed;
+
+    std::filesystem::remove_all(directory);
+    std::cout << (passed ? "No runs lost while closing" : "Runs lost while closing") << std::endl;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
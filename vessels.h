@@ -41,6 +41,37 @@ Vessel seihr(uint32_t N)
     return v;
 }
 
+// seihr without the exposed compartment, the incubation period is a gamma distributed delay instead
+Vessel seihr_delayed(uint32_t N)
+{
+    auto v = Vessel{};
+    const auto eps = 0.0009; // initial fraction of infectious
+    const auto I0 = size_t(std::round(eps*N)); // initial infectious
+    const auto S0 = N-I0; // initial susceptible
+    const auto R0 = 2.4; // basic reproductive number (initial, without lockdown etc)
+    const auto incubation_shape = 4.0; // incubation period ~ gamma with mean 5.1 days
+    const auto incubation_scale = 5.1 / incubation_shape;
+    const auto gamma = 1.0 / 3.1; // recovery rate (I -> R) ~3.1 days
+    const auto beta = R0 * gamma; // infection/generation rate (S+I -> E+I)
+    const auto P_H = 0.9e-3; // probability of hospitalization
+    const auto kappa = gamma * P_H*(1.0-P_H); // hospitalization rate (I -> H)
+    const auto tau = 1.0/10.12; // recovery/death rate in hospital (H -> R) ~10.12 days
+
+    // Reactants
+    auto S = v("S", S0); // susceptible
+    auto I = v("I", I0); // infectious
+    auto H = v("H", 0); // hospitalized
+    auto R = v("R", 0); // removed/immune (recovered + dead)
+
+    // Reactions
+    v(S >>= I, I, beta/N, ReactionDelay::gamma(incubation_shape, incubation_scale));
+    v(I >>= R, gamma);
+    v(I >>= H, kappa);
+    v(H >>= R, tau);
+
+    return v;
+}
+
 Vessel introduction(uint32_t A_start, uint32_t B_Start, uint32_t D_amount, double_t lambda) {
     auto v = Vessel{};
     // Reactants
@@ -150,4 +181,38 @@ Vessel circadian_oscillator2()
     return v;
 }
 
+/** generated mass conserving network for benchmarking the engines on thousands of reactions */
+Vessel random_network(size_t species_count, size_t reaction_count, uint32_t seed = 1)
+{
+    auto v = Vessel{};
+    std::mt19937 engine{seed};
+    std::uniform_int_distribution<size_t> pick{0, species_count - 1};
+    std::uniform_real_distribution<double_t> exponent{0.0, 1.0};
+
+    std::vector<Reactant> species{};
+    for (size_t i = 0; i < species_count; ++i) {
+        species.push_back(v("X" + std::to_string(i), 100));
+    }
+
+    // Rates spread over four orders of magnitude, a mix of conversions and bimolecular exchanges
+    v.reserve_reactions(reaction_count);
+    for (size_t r = 0; r < reaction_count; ++r) {
+        auto a = pick(engine), b = pick(engine), c = pick(engine), d = pick(engine);
+        while (b == a) b = pick(engine);
+        while (d == c) d = pick(engine);
+
+        if (r % 10 < 7) {
+            auto reaction = species[a] >>= species[b];
+            reaction.rate = std::pow(10.0, -3.0 + 4.0 * exponent(engine));
+            v.add_reaction(std::move(reaction));
+        } else {
+            auto reaction = species[a] + species[b] >>= species[c] + species[d];
+            reaction.rate = std::pow(10.0, -5.0 + 4.0 * exponent(engine));
+            v.add_reaction(std::move(reaction));
+        }
+    }
+
+    return v;
+}
+
 #endif //SP_EXAM_PROJECT_VESSELS_H